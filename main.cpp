@@ -1,7 +1,7 @@
 
 /**************************************************************
  *                       bankSim.cpp
-g++ main.cpp -std=c++17 -o bankSim
+g++ main.cpp -std=c++17 -pthread -o bankSim
 ./bankSim
  **************************************************************/
 
@@ -15,7 +15,37 @@ g++ main.cpp -std=c++17 -o bankSim
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <cmath>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <thread>
+#include <chrono>
+#include <list>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 #include "nlohmann/json.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86 1
+#endif
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -36,6 +66,8 @@ typedef struct {
     WORD state[8];
 } SHA256_CTX;
 
+typedef void (*SHA256_TRANSFORM)(SHA256_CTX *ctx, const BYTE data[]);
+
 #define ROTLEFT(a,b)  ((a << b) | (a >> (32-b)))
 #define ROTRIGHT(a,b) ((a >> b) | (a << (32-b)))
 
@@ -106,6 +138,85 @@ void sha256_transform(SHA256_CTX *ctx, const BYTE data[]) {
     ctx->state[7] += h;
 }
 
+#ifdef SHA256_X86
+// Reports whether the CPU supports the SHA extensions (and the SSSE3/SSE4.1 shuffles used alongside them)
+bool cpu_has_shani() {
+    unsigned int eax, ebx, ecx, edx;
+    bool sse41 = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_1) && (ecx & bit_SSSE3);
+    bool sha = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+    return sse41 && sha;
+}
+
+// Reports whether the CPU supports AVX2 and the OS saves the YMM registers
+bool cpu_has_avx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+        return false;
+    unsigned int xcr0, xcr0hi;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+    if ((xcr0 & 0x6) != 0x6)
+        return false;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+
+// SHA-256 core transformation using the x86 SHA extensions (same contract as sha256_transform)
+__attribute__((target("sha,ssse3,sse4.1")))
+void sha256_transform_shani(SHA256_CTX *ctx, const BYTE data[]) {
+    const __m128i BSWAP = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, abefSave, cdghSave, w[4];
+
+    // Rearrange a..h into the ABEF/CDGH lanes the instructions expect
+    tmp    = _mm_loadu_si128((const __m128i*)&ctx->state[0]);
+    state1 = _mm_loadu_si128((const __m128i*)&ctx->state[4]);
+    tmp    = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    abefSave = state0;
+    cdghSave = state1;
+
+    for (int i = 0; i < 4; ++i)
+        w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), BSWAP);
+
+    // 16 groups of 4 rounds; w[] holds a sliding window of the message schedule
+    for (int g = 0; g < 16; ++g) {
+        msg = _mm_add_epi32(w[g & 3], _mm_loadu_si128((const __m128i*)&k[g * 4]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        if (g < 12) {
+            tmp = _mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]);
+            tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+            w[g & 3] = _mm_sha256msg2_epu32(tmp, w[(g + 3) & 3]);
+        }
+    }
+
+    state0 = _mm_add_epi32(state0, abefSave);
+    state1 = _mm_add_epi32(state1, cdghSave);
+
+    // Back to a..h order
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&ctx->state[0], state0);
+    _mm_storeu_si128((__m128i*)&ctx->state[4], state1);
+}
+#endif
+
+// Picks the fastest block transform this CPU supports, falling back to the portable one
+SHA256_TRANSFORM sha256_select_transform() {
+#ifdef SHA256_X86
+    if (cpu_has_shani())
+        return sha256_transform_shani;
+#endif
+    return sha256_transform;
+}
+
+// Block transform used by sha256_update and sha256_final, chosen once at startup
+// (the self test swaps in each kernel in turn)
+static SHA256_TRANSFORM sha256_block = sha256_select_transform();
+
 // Initialize SHA-256 context
 void sha256_init(SHA256_CTX *ctx) {
     ctx->datalen = 0;
@@ -121,16 +232,32 @@ void sha256_init(SHA256_CTX *ctx) {
 }
 
 // Update SHA-256 context with input data
+// Full 64-byte blocks are transformed straight from the caller's buffer; only the tail is copied.
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len) {
-    for (size_t i = 0; i < len; ++i) {
-        ctx->data[ctx->datalen] = data[i];
-        ctx->datalen++;
-        if (ctx->datalen == 64) {
-            sha256_transform(ctx, ctx->data);
-            ctx->bitlen += 512;
-            ctx->datalen = 0;
-        }
+    size_t i = 0;
+
+    // Top up a partially filled block left over from a previous call
+    if (ctx->datalen > 0) {
+        size_t fill = 64 - ctx->datalen;
+        if (fill > len)
+            fill = len;
+        memcpy(ctx->data + ctx->datalen, data, fill);
+        ctx->datalen += fill;
+        i = fill;
+        if (ctx->datalen < 64)
+            return;
+        sha256_block(ctx, ctx->data);
+        ctx->bitlen += 512;
+        ctx->datalen = 0;
+    }
+
+    for ( ; i + 64 <= len; i += 64) {
+        sha256_block(ctx, data + i);
+        ctx->bitlen += 512;
     }
+
+    memcpy(ctx->data, data + i, len - i);
+    ctx->datalen = len - i;
 }
 
 // Finalize SHA-256 context and output hash
@@ -145,7 +272,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[]) {
         ctx->data[i++] = 0x80;
         while (i < 64)
             ctx->data[i++] = 0x00;
-        sha256_transform(ctx, ctx->data);
+        sha256_block(ctx, ctx->data);
         memset(ctx->data, 0, 56);
     }
 
@@ -158,7 +285,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[]) {
     ctx->data[58] = ctx->bitlen >> 40;
     ctx->data[57] = ctx->bitlen >> 48;
     ctx->data[56] = ctx->bitlen >> 56;
-    sha256_transform(ctx, ctx->data);
+    sha256_block(ctx, ctx->data);
 
     for (i = 0; i < 4; ++i) {
         hash[i]      = (ctx->state[0] >> (24 - i * 8)) & 0x000000ff;
@@ -170,383 +297,4099 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[]) {
         hash[i + 24] = (ctx->state[6] >> (24 - i * 8)) & 0x000000ff;
         hash[i + 28] = (ctx->state[7] >> (24 - i * 8)) & 0x000000ff;
     }
-}
-
-// Utility function to hash a string using SHA-256
-string sha256(const string& input) {
-    BYTE hash[SHA256_BLOCK_SIZE];
-    SHA256_CTX ctx;
-    sha256_init(&ctx);
-    sha256_update(&ctx, (const BYTE*)input.c_str(), input.length());
-    sha256_final(&ctx, hash);
+}
+
+// --------------------------
+// Hex encoding
+// --------------------------
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Maps an ASCII character to its hex value, or -1 if it is not a hex digit
+struct HexDecodeTable {
+    signed char value[256];
+    constexpr HexDecodeTable() : value() {
+        for (int i = 0; i < 256; i++) value[i] = -1;
+        for (int i = 0; i < 10; i++) value['0' + i] = (signed char)i;
+        for (int i = 0; i < 6; i++) {
+            value['a' + i] = (signed char)(10 + i);
+            value['A' + i] = (signed char)(10 + i);
+        }
+    }
+};
+static constexpr HexDecodeTable HEX_VALUES;
+
+// Writes len bytes as 2*len lowercase hex characters to out (not null-terminated)
+void hex_encode(const BYTE data[], size_t len, char out[]) {
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2]     = HEX_DIGITS[data[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[data[i] & 0x0f];
+    }
+}
+
+// Parses 2*len hex characters from text into len bytes; returns false on any non-hex character
+bool hex_decode(const char text[], size_t len, BYTE out[]) {
+    for (size_t i = 0; i < len; i++) {
+        int hi = HEX_VALUES.value[(BYTE)text[i * 2]];
+        int lo = HEX_VALUES.value[(BYTE)text[i * 2 + 1]];
+        if ((hi | lo) < 0)
+            return false;
+        out[i] = (BYTE)((hi << 4) | lo);
+    }
+    return true;
+}
+
+// Utility function to hash a string using SHA-256
+string sha256(const string& input) {
+    BYTE hash[SHA256_BLOCK_SIZE];
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const BYTE*)input.c_str(), input.length());
+    sha256_final(&ctx, hash);
+
+    string hexDigest(SHA256_BLOCK_SIZE * 2, '\0');
+    hex_encode(hash, SHA256_BLOCK_SIZE, &hexDigest[0]);
+    return hexDigest;
+}
+
+// --------------------------
+// Digest
+// --------------------------
+// A raw 32-byte SHA-256 digest. Kept in binary in memory; hex is only used at the JSON boundary.
+struct Digest {
+    BYTE bytes[SHA256_BLOCK_SIZE] = {};
+
+    bool operator==(const Digest& other) const {
+        return memcmp(bytes, other.bytes, SHA256_BLOCK_SIZE) == 0;
+    }
+    bool operator!=(const Digest& other) const {
+        return !(*this == other);
+    }
+    // Returns the digest as 64 lowercase hex characters.
+    string toHex() const {
+        string text(SHA256_BLOCK_SIZE * 2, '\0');
+        hex_encode(bytes, SHA256_BLOCK_SIZE, &text[0]);
+        return text;
+    }
+    // Parses 64 hex characters into out; returns false (leaving out zeroed) if the text is malformed.
+    static bool fromHex(const string& text, Digest& out) {
+        if (text.length() != SHA256_BLOCK_SIZE * 2 || !hex_decode(text.data(), SHA256_BLOCK_SIZE, out.bytes)) {
+            out = Digest();
+            return false;
+        }
+        return true;
+    }
+};
+
+namespace std {
+template <> struct hash<Digest> {
+    // SHA-256 output is uniformly distributed, so its leading bytes are already a good hash.
+    size_t operator()(const Digest& d) const {
+        size_t h;
+        memcpy(&h, d.bytes, sizeof(h));
+        return h;
+    }
+};
+}
+
+// Utility function to hash a string using SHA-256, returning the raw digest
+Digest sha256_digest(const string& input) {
+    Digest digest;
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const BYTE*)input.c_str(), input.length());
+    sha256_final(&ctx, digest.bytes);
+    return digest;
+}
+
+// --------------------------
+// Multi-buffer SHA-256
+// --------------------------
+// Hashes each message on its own with the single-buffer code path.
+void sha256_many_scalar(const BYTE* const data[], const size_t lens[], size_t count, BYTE hashes[][SHA256_BLOCK_SIZE]) {
+    SHA256_CTX ctx;
+    for (size_t i = 0; i < count; ++i) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, data[i], lens[i]);
+        sha256_final(&ctx, hashes[i]);
+    }
+}
+
+#ifdef SHA256_X86
+#define X8_ROTR(x,n)  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define X8_ADD(a,b)   _mm256_add_epi32(a, b)
+#define X8_XOR3(a,b,c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+// Hashes messages eight at a time, one per 32-bit AVX2 lane. Each lane walks its own
+// message block by block; lanes whose message has run out keep their finished state.
+__attribute__((target("avx2")))
+void sha256_many_avx2(const BYTE* const data[], const size_t lens[], size_t count, BYTE hashes[][SHA256_BLOCK_SIZE]) {
+    static const BYTE empty[1] = {0};
+    // Per-lane copy of the final one or two blocks: message tail, 0x80, zeros, bit length
+    BYTE tail[8][128];
+    const BYTE* msg[8];
+    size_t fullBlocks[8];
+    int blocks[8];
+    WORD words[8];
+    __m256i st[8], w[64];
+
+    for (size_t base = 0; base < count; base += 8) {
+        int maxBlocks = 0;
+        for (int j = 0; j < 8; ++j) {
+            size_t len = base + j < count ? lens[base + j] : 0;
+            msg[j] = base + j < count ? data[base + j] : empty;
+            fullBlocks[j] = len / 64;
+            size_t rest = len % 64;
+            size_t tailLen = rest < 56 ? 64 : 128;
+            memcpy(tail[j], msg[j] + fullBlocks[j] * 64, rest);
+            tail[j][rest] = 0x80;
+            memset(tail[j] + rest + 1, 0, tailLen - rest - 1);
+            unsigned long long bitlen = (unsigned long long)len * 8;
+            for (int b = 0; b < 8; ++b)
+                tail[j][tailLen - 1 - b] = (BYTE)(bitlen >> (8 * b));
+            blocks[j] = (int)(fullBlocks[j] + tailLen / 64);
+            if (blocks[j] > maxBlocks)
+                maxBlocks = blocks[j];
+        }
+
+        st[0] = _mm256_set1_epi32(0x6a09e667);
+        st[1] = _mm256_set1_epi32(0xbb67ae85);
+        st[2] = _mm256_set1_epi32(0x3c6ef372);
+        st[3] = _mm256_set1_epi32(0xa54ff53a);
+        st[4] = _mm256_set1_epi32(0x510e527f);
+        st[5] = _mm256_set1_epi32(0x9b05688c);
+        st[6] = _mm256_set1_epi32(0x1f83d9ab);
+        st[7] = _mm256_set1_epi32(0x5be0cd19);
+        const __m256i laneBlocks = _mm256_loadu_si256((const __m256i*)blocks);
+
+        for (int blk = 0; blk < maxBlocks; ++blk) {
+            const BYTE* p[8];
+            for (int j = 0; j < 8; ++j) {
+                if ((size_t)blk < fullBlocks[j])
+                    p[j] = msg[j] + blk * 64;
+                else if (blk < blocks[j])
+                    p[j] = tail[j] + (blk - fullBlocks[j]) * 64;
+                else
+                    p[j] = tail[j];  // finished lane; result is discarded below
+            }
+            for (int t = 0; t < 16; ++t) {
+                for (int j = 0; j < 8; ++j) {
+                    const BYTE* q = p[j] + t * 4;
+                    words[j] = ((WORD)q[0] << 24) | ((WORD)q[1] << 16) | ((WORD)q[2] << 8) | q[3];
+                }
+                w[t] = _mm256_loadu_si256((const __m256i*)words);
+            }
+            for (int t = 16; t < 64; ++t) {
+                __m256i s0 = X8_XOR3(X8_ROTR(w[t-15], 7), X8_ROTR(w[t-15], 18), _mm256_srli_epi32(w[t-15], 3));
+                __m256i s1 = X8_XOR3(X8_ROTR(w[t-2], 17), X8_ROTR(w[t-2], 19), _mm256_srli_epi32(w[t-2], 10));
+                w[t] = X8_ADD(X8_ADD(s1, w[t-7]), X8_ADD(s0, w[t-16]));
+            }
+
+            __m256i a = st[0], b = st[1], c = st[2], d = st[3];
+            __m256i e = st[4], f = st[5], g = st[6], h = st[7];
+            for (int t = 0; t < 64; ++t) {
+                __m256i ep1 = X8_XOR3(X8_ROTR(e, 6), X8_ROTR(e, 11), X8_ROTR(e, 25));
+                __m256i ch  = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                __m256i t1  = X8_ADD(X8_ADD(h, ep1), X8_ADD(ch, X8_ADD(_mm256_set1_epi32(k[t]), w[t])));
+                __m256i ep0 = X8_XOR3(X8_ROTR(a, 2), X8_ROTR(a, 13), X8_ROTR(a, 22));
+                __m256i maj = X8_XOR3(_mm256_and_si256(a, b), _mm256_and_si256(a, c), _mm256_and_si256(b, c));
+                h = g;
+                g = f;
+                f = e;
+                e = X8_ADD(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = X8_ADD(t1, X8_ADD(ep0, maj));
+            }
+
+            const __m256i active = _mm256_cmpgt_epi32(laneBlocks, _mm256_set1_epi32(blk));
+            __m256i out[8] = {a, b, c, d, e, f, g, h};
+            for (int i = 0; i < 8; ++i)
+                st[i] = _mm256_blendv_epi8(st[i], X8_ADD(st[i], out[i]), active);
+        }
+
+        for (int i = 0; i < 8; ++i) {
+            _mm256_storeu_si256((__m256i*)words, st[i]);
+            for (int j = 0; j < 8 && base + j < count; ++j) {
+                hashes[base + j][i * 4]     = (BYTE)(words[j] >> 24);
+                hashes[base + j][i * 4 + 1] = (BYTE)(words[j] >> 16);
+                hashes[base + j][i * 4 + 2] = (BYTE)(words[j] >> 8);
+                hashes[base + j][i * 4 + 3] = (BYTE)words[j];
+            }
+        }
+    }
+}
+
+#undef X8_ROTR
+#undef X8_ADD
+#undef X8_XOR3
+#endif
+
+typedef void (*SHA256_MANY)(const BYTE* const data[], const size_t lens[], size_t count, BYTE hashes[][SHA256_BLOCK_SIZE]);
+
+// Picks the batch hashing kernel for this CPU. SHA-NI hashes a single short message faster
+// than the eight-lane AVX2 kernel, so multi-buffer is only used on CPUs without it.
+SHA256_MANY sha256_select_many() {
+#ifdef SHA256_X86
+    if (!cpu_has_shani() && cpu_has_avx2())
+        return sha256_many_avx2;
+#endif
+    return sha256_many_scalar;
+}
+
+static const SHA256_MANY sha256_many_kernel = sha256_select_many();
+
+// Hashes count independent messages, writing the digest of data[i] to hashes[i]
+void sha256_many(const BYTE* const data[], const size_t lens[], size_t count, BYTE hashes[][SHA256_BLOCK_SIZE]) {
+    sha256_many_kernel(data, lens, count, hashes);
+}
+
+// Utility function to hash many strings at once; returns digests in input order
+vector<Digest> sha256_many(const vector<string>& inputs) {
+    vector<const BYTE*> data(inputs.size());
+    vector<size_t> lens(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        data[i] = (const BYTE*)inputs[i].data();
+        lens[i] = inputs[i].length();
+    }
+    vector<Digest> result(inputs.size());
+    static_assert(sizeof(Digest) == SHA256_BLOCK_SIZE, "Digest must be exactly the raw hash bytes");
+    sha256_many(data.data(), lens.data(), inputs.size(), (BYTE(*)[SHA256_BLOCK_SIZE])result.data());
+    return result;
+}
+
+// ==========================
+//   CRC-32 (IEEE 802.3) for on-disk record checksums
+// ==========================
+// Lookup table for the reflected CRC-32 polynomial 0xEDB88320
+struct Crc32Table {
+    uint32_t value[256];
+    constexpr Crc32Table() : value() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            value[i] = c;
+        }
+    }
+};
+static constexpr Crc32Table CRC32_TABLE;
+
+// Computes the CRC-32 of len bytes; pass a previous result as crc to checksum data in pieces
+uint32_t crc32(const void* data, size_t len, uint32_t crc = 0) {
+    const BYTE* p = (const BYTE*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = CRC32_TABLE.value[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ==========================
+//   Binary record buffers (native byte order)
+// ==========================
+// Appends fixed-size values and length-prefixed strings to a byte buffer.
+struct ByteWriter {
+    vector<char> bytes;
+
+    template <typename T>
+    void put(const T& value) {
+        const char* p = (const char*)&value;
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+    void putString(const string& text) {
+        put<uint32_t>((uint32_t)text.length());
+        bytes.insert(bytes.end(), text.begin(), text.end());
+    }
+};
+
+// Reads values written by ByteWriter; every read is bounds-checked and ok() turns false on overrun.
+struct ByteReader {
+    const char* p;
+    const char* end;
+    bool good = true;
+
+    ByteReader(const char* data, size_t len) : p(data), end(data + len) {}
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (good && (size_t)(end - p) >= sizeof(T)) {
+            memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+        } else {
+            good = false;
+        }
+        return value;
+    }
+    string getString() {
+        uint32_t len = get<uint32_t>();
+        if (!good || (size_t)(end - p) < len) {
+            good = false;
+            return string();
+        }
+        string text(p, len);
+        p += len;
+        return text;
+    }
+    bool ok() const { return good; }
+};
+
+// ==========================
+//   Vault file encoding
+// ==========================
+// How profile.json and account.json are written. The name stays .json whatever the encoding.
+enum class VaultFormat { Pretty, Compact, Cbor, MsgPack };
+
+// Parses a --vault-format name; returns false if it is not one of pretty, compact, cbor, msgpack.
+bool parseVaultFormat(const string& name, VaultFormat& format) {
+    if (name == "pretty") format = VaultFormat::Pretty;
+    else if (name == "compact") format = VaultFormat::Compact;
+    else if (name == "cbor") format = VaultFormat::Cbor;
+    else if (name == "msgpack") format = VaultFormat::MsgPack;
+    else return false;
+    return true;
+}
+
+// Encodes a vault record in the given format.
+string encodeVaultRecord(const nlohmann::json& record, VaultFormat format) {
+    switch (format) {
+        case VaultFormat::Pretty:
+            return record.dump(4);
+        case VaultFormat::Cbor: {
+            vector<uint8_t> bytes = nlohmann::json::to_cbor(record);
+            return string(bytes.begin(), bytes.end());
+        }
+        case VaultFormat::MsgPack: {
+            vector<uint8_t> bytes = nlohmann::json::to_msgpack(record);
+            return string(bytes.begin(), bytes.end());
+        }
+        default:
+            return record.dump();
+    }
+}
+
+// Tells the encodings of a vault record apart by its first byte: a record is always an object,
+// which is a map in CBOR (0xa0-0xbf) and MessagePack (0x80-0x8f, 0xde, 0xdf).
+nlohmann::json::input_format_t vaultInputFormat(const string& data) {
+    unsigned char first = data.empty() ? 0 : (unsigned char)data[0];
+    if (first >= 0xa0 && first <= 0xbf) {
+        return nlohmann::json::input_format_t::cbor;
+    }
+    if ((first >= 0x80 && first <= 0x8f) || first == 0xde || first == 0xdf) {
+        return nlohmann::json::input_format_t::msgpack;
+    }
+    return nlohmann::json::input_format_t::json;
+}
+
+// Decodes a vault record in any encoding into a DOM.
+nlohmann::json decodeVaultRecord(const string& data) {
+    switch (vaultInputFormat(data)) {
+        case nlohmann::json::input_format_t::cbor:
+            return nlohmann::json::from_cbor(data.begin(), data.end());
+        case nlohmann::json::input_format_t::msgpack:
+            return nlohmann::json::from_msgpack(data.begin(), data.end());
+        default:
+            return nlohmann::json::parse(data);
+    }
+}
+
+// Reads a whole file into data; returns false if it cannot be opened.
+bool readWholeFile(const string& path, string& data) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in.is_open()) {
+        return false;
+    }
+    data.resize((size_t)in.tellg());
+    in.seekg(0);
+    in.read(&data[0], data.size());
+    return (bool)in;
+}
+
+// Reads a vault record in any format; returns false if the file cannot be opened or parsed.
+bool readVaultFile(const string& path, nlohmann::json& record) {
+    string data;
+    if (!readWholeFile(path, data)) {
+        return false;
+    }
+    try {
+        record = decodeVaultRecord(data);
+    } catch (const nlohmann::json::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Top-level fields of a profile.json or account.json, as read by VaultRecordSax. Fields the
+// file does not have keep their defaults.
+struct VaultRecord {
+    string username;
+    string password;            // hex SHA-256 of the password
+    string accountNumber;       // hex SHA-256 of the account number
+    string name;
+    long long number = 0;
+    bool hasBalanceCents = false;
+    long long balanceCents = 0;
+    double balance = 0.0;       // legacy floating-point dollars
+};
+
+// SAX handler for nlohmann::json::sax_parse that copies the top-level fields of a vault record
+// straight into a VaultRecord, so no DOM is built. Nested values are skipped.
+class VaultRecordSax {
+private:
+    VaultRecord& out;
+    int depth = 0;
+    bool sawObject = false;
+    std::string currentKey;
+
+    void integer(long long value) {
+        if (depth != 1) {
+            return;
+        }
+        if (currentKey == "number") {
+            out.number = value;
+        } else if (currentKey == "balanceCents") {
+            out.hasBalanceCents = true;
+            out.balanceCents = value;
+        } else if (currentKey == "balance") {
+            out.balance = (double)value;
+        }
+    }
+
+public:
+    explicit VaultRecordSax(VaultRecord& record) : out(record) {}
+
+    // True once the input has turned out to be an object, as every vault record is.
+    bool sawRecord() const { return sawObject; }
+
+    bool null() { return true; }
+    bool boolean(bool) { return true; }
+    bool number_integer(nlohmann::json::number_integer_t value) {
+        integer(value);
+        return true;
+    }
+    bool number_unsigned(nlohmann::json::number_unsigned_t value) {
+        integer((long long)value);
+        return true;
+    }
+    bool number_float(nlohmann::json::number_float_t value, const std::string&) {
+        if (depth == 1 && currentKey == "balance") {
+            out.balance = value;
+        }
+        return true;
+    }
+    bool string(std::string& value) {
+        if (depth != 1) {
+            return true;
+        }
+        if (currentKey == "username") {
+            out.username = std::move(value);
+        } else if (currentKey == "password") {
+            out.password = std::move(value);
+        } else if (currentKey == "accountNumber") {
+            out.accountNumber = std::move(value);
+        } else if (currentKey == "name") {
+            out.name = std::move(value);
+        }
+        return true;
+    }
+    bool binary(nlohmann::json::binary_t&) { return true; }
+    bool start_object(size_t) {
+        sawObject = sawObject || depth == 0;
+        depth++;
+        return true;
+    }
+    bool key(std::string& value) {
+        if (depth == 1) {
+            currentKey.swap(value);
+        }
+        return true;
+    }
+    bool end_object() {
+        depth--;
+        return true;
+    }
+    bool start_array(size_t) {
+        depth++;
+        return true;
+    }
+    bool end_array() {
+        depth--;
+        return true;
+    }
+    bool parse_error(size_t, const std::string&, const nlohmann::json::exception&) { return false; }
+};
+
+// Reads a vault record in any format straight into its fields; returns false if the file cannot
+// be opened or is not a well-formed record.
+bool readVaultRecord(const string& path, VaultRecord& record) {
+    string data;
+    if (!readWholeFile(path, data)) {
+        return false;
+    }
+    VaultRecordSax sax(record);
+    return nlohmann::json::sax_parse(data, &sax, vaultInputFormat(data)) && sax.sawRecord();
+}
+
+// Writes all len bytes to fd, continuing after short writes; returns false on error.
+bool writeFully(int fd, const void* data, size_t len) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Flushes a directory's entries to disk, making renames and removals in it durable.
+bool syncDirectory(const string& dir) {
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+// Writes the vault files of one save pass so that a crash leaves each file either old or new,
+// never half-written. Every file goes to a .tmp sibling first; commit() flushes the data of all
+// of them, renames them into place in the order written, then flushes the directory entries.
+// On Linux each flush is one syncfs for the whole pass; elsewhere it is an fsync per file and
+// per directory touched.
+class VaultWriteBatch {
+private:
+    string root;
+    vector<string> paths;
+    bool failed = false;
+    string firstError;
+
+    // Marks the batch failed, keeping the first failure (path and errno) for error().
+    void fail(const string& path, int err) {
+        if (firstError.empty()) {
+            firstError = "Unable to write " + path + ": " + strerror(err);
+        }
+        failed = true;
+    }
+
+public:
+    explicit VaultWriteBatch(const string& rootDir) : root(rootDir) {}
+
+    // Describes the first file that could not be written, or is empty if none has failed.
+    const string& error() const { return firstError; }
+
+    // Writes record to path's temporary file, creating its directory if needed; it replaces path
+    // on commit().
+    void write(const string& path, const nlohmann::json& record, VaultFormat format) {
+        string data = encodeVaultRecord(record, format);
+        string tempName = path + ".tmp";
+        // A directory that cannot be created fails the open below, and with it the batch
+        error_code ec;
+        fs::create_directories(fs::path(path).parent_path(), ec);
+        int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool written = fd >= 0 && writeFully(fd, data.data(), data.size());
+#ifndef __linux__
+        written = written && ::fsync(fd) == 0;
+#endif
+        int err = errno;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!written) {
+            fail(path, err);
+            ::unlink(tempName.c_str());
+            return;
+        }
+        paths.push_back(path);
+    }
+
+    // Makes every file written so far durable and visible. Returns false if any write failed; the
+    // caller reports error().
+    bool commit() {
+        if (paths.empty()) {
+            return !failed;
+        }
+#ifdef __linux__
+        int rootFd = ::open(root.c_str(), O_RDONLY);
+        if (rootFd >= 0) {
+            ::syncfs(rootFd);
+        } else {
+            ::sync();
+        }
+#endif
+        for (const string& path : paths) {
+            if (::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+                fail(path, errno);
+            }
+        }
+#ifdef __linux__
+        if (rootFd >= 0) {
+            ::syncfs(rootFd);
+            ::close(rootFd);
+        } else {
+            ::sync();
+        }
+#else
+        unordered_set<string> dirs;
+        for (const string& path : paths) {
+            // A new user directory must be flushed in its parent as well
+            fs::path dir = fs::path(path).parent_path();
+            dirs.insert(dir.string());
+            dirs.insert(dir.parent_path().string());
+        }
+        for (const string& dir : dirs) {
+            syncDirectory(dir);
+        }
+#endif
+        paths.clear();
+        return !failed;
+    }
+};
+
+// ==========================
+//        Class Definitions
+// ==========================
+
+// --------------------------
+// Money Class
+// --------------------------
+// Number of decimal places money is kept to; amounts are stored as integer multiples of 10^-MONEY_DECIMALS.
+const int MONEY_DECIMALS = 2;
+
+// Returns 10^n at compile time.
+constexpr long long pow10ll(int n) {
+    return n == 0 ? 1 : 10 * pow10ll(n - 1);
+}
+
+// Minor units (cents) per dollar.
+constexpr long long MONEY_SCALE = pow10ll(MONEY_DECIMALS);
+
+// The Money class holds an exact amount as a 64-bit count of cents, with overflow-checked arithmetic.
+class Money {
+private:
+    long long cents;
+public:
+    // Constructs an amount from a count of cents (zero by default).
+    explicit Money(long long minorUnits = 0) : cents(minorUnits) {}
+
+    // Returns the amount as a count of cents.
+    long long getCents() const { return cents; }
+
+    // Sets result to this + other; returns false (leaving result untouched) on overflow.
+    bool checkedAdd(Money other, Money& result) const {
+        long long sum;
+        if (__builtin_add_overflow(cents, other.cents, &sum)) {
+            return false;
+        }
+        result = Money(sum);
+        return true;
+    }
+    // Sets result to this - other; returns false (leaving result untouched) on overflow.
+    bool checkedSub(Money other, Money& result) const {
+        long long diff;
+        if (__builtin_sub_overflow(cents, other.cents, &diff)) {
+            return false;
+        }
+        result = Money(diff);
+        return true;
+    }
+
+    bool operator==(Money other) const { return cents == other.cents; }
+    bool operator!=(Money other) const { return cents != other.cents; }
+    bool operator<(Money other) const { return cents < other.cents; }
+    bool operator<=(Money other) const { return cents <= other.cents; }
+    bool operator>(Money other) const { return cents > other.cents; }
+    bool operator>=(Money other) const { return cents >= other.cents; }
+
+    // Parses an amount such as "12", "12.5", "$12.50" or "-3.25".
+    // Returns false if the text is malformed, has more decimals than MONEY_DECIMALS, or overflows.
+    static bool parse(const string& text, Money& out) {
+        size_t i = 0;
+        bool negative = false;
+        if (i < text.length() && text[i] == '$') i++;
+        if (i < text.length() && (text[i] == '-' || text[i] == '+')) {
+            negative = text[i] == '-';
+            i++;
+        }
+        long long whole = 0;
+        int digits = 0;
+        while (i < text.length() && isdigit((unsigned char)text[i])) {
+            if (__builtin_mul_overflow(whole, 10, &whole) || __builtin_add_overflow(whole, text[i] - '0', &whole)) {
+                return false;
+            }
+            i++;
+            digits++;
+        }
+        long long fraction = 0;
+        int fractionDigits = 0;
+        if (i < text.length() && text[i] == '.') {
+            i++;
+            while (i < text.length() && isdigit((unsigned char)text[i])) {
+                if (fractionDigits == MONEY_DECIMALS) {
+                    return false;
+                }
+                fraction = fraction * 10 + (text[i] - '0');
+                i++;
+                fractionDigits++;
+            }
+        }
+        if (i != text.length() || digits + fractionDigits == 0) {
+            return false;
+        }
+        for ( ; fractionDigits < MONEY_DECIMALS; fractionDigits++) {
+            fraction *= 10;
+        }
+        long long total;
+        if (__builtin_mul_overflow(whole, MONEY_SCALE, &total) || __builtin_add_overflow(total, fraction, &total)) {
+            return false;
+        }
+        out = Money(negative ? -total : total);
+        return true;
+    }
+    // Converts a floating-point dollar amount (the old vault format), rounding to the nearest cent.
+    static bool fromDollars(double dollars, Money& out) {
+        double scaled = std::round(dollars * MONEY_SCALE);
+        if (!std::isfinite(scaled) || scaled >= 9.2e18 || scaled <= -9.2e18) {
+            return false;
+        }
+        out = Money((long long)scaled);
+        return true;
+    }
+    // Formats the amount with exactly MONEY_DECIMALS decimal places, e.g. "1234.50".
+    string toString() const {
+        unsigned long long magnitude = cents < 0 ? 0ULL - (unsigned long long)cents : (unsigned long long)cents;
+        string text = (cents < 0 ? "-" : "") + to_string(magnitude / MONEY_SCALE);
+        if (MONEY_DECIMALS > 0) {
+            string fraction = to_string(magnitude % MONEY_SCALE);
+            text += "." + string(MONEY_DECIMALS - fraction.length(), '0') + fraction;
+        }
+        return text;
+    }
+};
+
+// Writes an amount as dollars and cents.
+ostream& operator<<(ostream& out, Money amount) {
+    return out << amount.toString();
+}
+
+// Reads a whitespace-delimited amount; sets failbit if the token is not a valid amount.
+istream& operator>>(istream& in, Money& amount) {
+    string token;
+    if (in >> token && !Money::parse(token, amount)) {
+        in.setstate(ios::failbit);
+    }
+    return in;
+}
+
+// Outcome of an account operation; the caller decides how (or whether) to report it.
+enum class AccountResult {
+    Ok,
+    InvalidAmount,
+    InsufficientFunds,
+    Overflow
+};
+
+// --------------------------
+// Account Class
+// --------------------------
+// The Account class represents a bank account with basic operations like deposit, withdraw, and transfer.
+class Account {
+private:
+    string ownerName;
+    int accountNumber;
+    Money balance;
+    // When set, the balance lives in a memory-mapped account table record instead of this object.
+    Money* mappedBalance = nullptr;
+    // Returns the storage currently holding the balance.
+    Money& bal() { return mappedBalance != nullptr ? *mappedBalance : balance; }
+    const Money& bal() const { return mappedBalance != nullptr ? *mappedBalance : balance; }
+public:
+    // Constructs an Account with the owner's name, account number, and initial deposit.
+    Account(string name, int accNumber, Money initialDeposit) {
+        ownerName = name;
+        accountNumber = accNumber;
+        balance = initialDeposit;
+    }
+
+    // Deposits a positive amount into the account.
+    AccountResult deposit(Money amount) {
+        if (amount <= Money(0)) {
+            return AccountResult::InvalidAmount;
+        }
+        if (!bal().checkedAdd(amount, bal())) {
+            return AccountResult::Overflow;
+        }
+        return AccountResult::Ok;
+    }
+
+    // Withdraws a positive amount from the account, if sufficient funds exist.
+    AccountResult withdraw(Money amount) {
+        if (amount <= Money(0)) {
+            return AccountResult::InvalidAmount;
+        }
+        if (amount > bal()) {
+            return AccountResult::InsufficientFunds;
+        }
+        bal().checkedSub(amount, bal());
+        return AccountResult::Ok;
+    }
+
+    // Transfers a positive amount to another account, if sufficient funds exist.
+    // Overflow means the recipient's balance could not hold the amount.
+    AccountResult transferTo(Account& other, Money amount) {
+        Money credited;
+        if (amount <= Money(0)) {
+            return AccountResult::InvalidAmount;
+        }
+        if (amount > bal()) {
+            return AccountResult::InsufficientFunds;
+        }
+        // Debit first so that a transfer to the same account credits its current balance
+        Money debited = bal();
+        bal().checkedSub(amount, bal());
+        if (!other.bal().checkedAdd(amount, credited)) {
+            bal() = debited;
+            return AccountResult::Overflow;
+        }
+        other.bal() = credited;
+        return AccountResult::Ok;
+    }
+
+    // Returns the account number.
+    int getAccountNumber() const { return accountNumber; }
+    // Returns the owner's name.
+    string getOwnerName() const { return ownerName; }
+    // Returns the current balance.
+    Money getBalance() const { return bal(); }
+    // Sets the balance directly; used when replaying the transaction log.
+    void restoreBalance(Money amount) { bal() = amount; }
+    // Moves the balance into slot (an account table record, already holding the current value);
+    // from then on every read and update goes straight to that record.
+    void mapBalance(Money* slot) { mappedBalance = slot; }
+    // Displays account details.
+    void display(ostream& out = cout) const {
+        out << "Account #" << accountNumber << " | Owner: " << ownerName << " | Balance: $" << bal() << '\n';
+    }
+};
+
+// Writes the message for the result of depositing amount into account.
+void reportDeposit(ostream& out, AccountResult result, Money amount, int account) {
+    switch (result) {
+    case AccountResult::Ok:
+        out << "Deposited $" << amount << " to account " << account << '\n';
+        break;
+    case AccountResult::Overflow:
+        out << "Deposit would overflow account " << account << ".\n";
+        break;
+    default:
+        out << "Invalid deposit amount.\n";
+        break;
+    }
+}
+
+// Writes the message for the result of withdrawing amount from account.
+void reportWithdrawal(ostream& out, AccountResult result, Money amount, int account) {
+    switch (result) {
+    case AccountResult::Ok:
+        out << "Withdrew $" << amount << " from account " << account << '\n';
+        break;
+    case AccountResult::InsufficientFunds:
+        out << "Insufficient funds in account " << account << ".\n";
+        break;
+    default:
+        out << "Invalid withdrawal amount.\n";
+        break;
+    }
+}
+
+// Writes the message for the result of transferring amount between two accounts.
+void reportTransfer(ostream& out, AccountResult result, Money amount, int from, int to) {
+    switch (result) {
+    case AccountResult::Ok:
+        out << "Transferred $" << amount << " from account " << from << " to account " << to << ".\n";
+        break;
+    case AccountResult::InsufficientFunds:
+        out << "Insufficient funds in account " << from << " for transfer.\n";
+        break;
+    case AccountResult::Overflow:
+        out << "Transfer would overflow account " << to << ".\n";
+        break;
+    default:
+        out << "Invalid transfer amount.\n";
+        break;
+    }
+}
+
+// Starts the result line of a text command whose change was applied but could not be written to
+// the transaction log yet; the log retries it on its next commit.
+const char* const NOT_DURABLE_PREFIX = "ERR not yet durable, will be retried: ";
+// Shown by the menus after such a change.
+const char* const NOT_DURABLE_WARNING = "This change could not be written to the transaction log yet; it will be retried.\n";
+
+// --------------------------
+// User Class (base)
+// --------------------------
+// The User class is a base class for customers and employees, storing username and password.
+class User {
+private:
+    string username;
+    Digest password;
+public:
+    // Constructs a User with a username and password (hashes the password).
+    User(string uname, string pword)
+        : username(uname), password(sha256_digest(pword)) {}
+    // Constructs a User with a username and a password, with option to specify if password is already hashed (hex).
+    User(string uname, string pword, bool isHashed)
+        : username(uname) {
+        if (isHashed) {
+            Digest::fromHex(pword, password);
+        } else {
+            password = sha256_digest(pword);
+        }
+    }
+    // Constructs a User from a username and an already computed password digest.
+    User(string uname, const Digest& passwordHash)
+        : username(uname), password(passwordHash) {}
+    // Returns the username.
+    string getUsername() const { return username; }
+    // Checks if the given password matches the user's password (hashes input before comparison).
+    bool checkPassword(const string& input) const {
+        return sha256_digest(input) == password;
+    }
+    // Returns the hashed password.
+    const Digest& getPassword() const { return password; }
+    // Virtual destructor for base class.
+    virtual ~User() {}
+};
+
+// --------------------------
+// Customer Class
+// --------------------------
+// The Customer class represents a bank customer and associates them with an account.
+class Customer : public User {
+private:
+    Digest accountHash;
+public:
+    // Constructs a Customer with username, password, and account hash.
+    Customer(string uname, string pword, const Digest& accHash, bool isHashed = false)
+        : User(uname, pword, isHashed), accountHash(accHash) {}
+    // Constructs a Customer from a username and already computed password and account digests.
+    Customer(string uname, const Digest& passwordHash, const Digest& accHash)
+        : User(uname, passwordHash), accountHash(accHash) {}
+    // Returns the associated account hash.
+    const Digest& getAccountHash() const { return accountHash; }
+};
+
+// --------------------------
+// Employee Class
+// --------------------------
+// The Employee class represents a bank employee with access to view all accounts.
+class Employee : public User {
+public:
+    // Constructs an Employee with username and password.
+    Employee(string uname, string pword, bool isHashed = false)
+        : User(uname, pword, isHashed) {}
+    // Constructs an Employee from a username and an already computed password digest.
+    Employee(string uname, const Digest& passwordHash)
+        : User(uname, passwordHash) {}
+    // Allows employee to view all accounts in the bank.
+    void viewAllAccounts(class Bank& bank) const;
+};
+
+// --------------------------
+// TransactionLog Class
+// --------------------------
+// The TransactionLog is an append-only write-ahead log of balance changes. Each record holds the
+// new balances of the one or two accounts an operation touched, so replaying it is idempotent.
+// Records are buffered and written with a single fsync per group (group commit).
+class TransactionLog {
+public:
+    // One operation's after-images. Fixed size, so a torn tail is easy to detect and drop.
+    struct Record {
+        uint32_t magic;
+        uint32_t count;        // number of entries used (1 or 2)
+        int32_t number[2];     // account numbers
+        int64_t cents[2];      // balances after the operation
+        uint32_t checksum;     // CRC-32 of every byte before this field
+        uint32_t reserved;
+    };
+    static constexpr uint32_t RECORD_MAGIC = 0x4C57424B; // "KBWL"
+private:
+    int fd = -1;
+    vector<Record> pending;
+    size_t groupSize = 1;
+    // Length of the log up to its last durable record; a failed commit is cut back to it.
+    off_t durableEnd = 0;
+public:
+    TransactionLog() {}
+    TransactionLog(const TransactionLog&) = delete;
+    TransactionLog& operator=(const TransactionLog&) = delete;
+    ~TransactionLog() {
+        close();
+    }
+
+    // Reads every intact record from the log at path, then opens it for appending.
+    // A torn or corrupt tail (from a crash mid-write) is truncated away.
+    vector<Record> open(const string& path) {
+        close();
+        vector<Record> records;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            cout << "Unable to open transaction log " << path << '\n';
+            return records;
+        }
+        Record rec;
+        off_t good = 0;
+        while (::pread(fd, &rec, sizeof(rec), good) == (ssize_t)sizeof(rec)
+               && rec.magic == RECORD_MAGIC && rec.count >= 1 && rec.count <= 2
+               && rec.checksum == crc32(&rec, offsetof(Record, checksum))) {
+            records.push_back(rec);
+            good += sizeof(rec);
+        }
+        if (::lseek(fd, 0, SEEK_END) != good) {
+            if (::ftruncate(fd, good) != 0) {
+                cout << "Unable to trim damaged transaction log " << path << '\n';
+            }
+        }
+        ::lseek(fd, good, SEEK_SET);
+        durableEnd = good;
+        return records;
+    }
+
+    // Sets how many records are buffered before they are written and fsynced together.
+    void setGroupSize(size_t records) {
+        groupSize = records == 0 ? 1 : records;
+    }
+
+    // Queues the new balances of one operation; commits once a full group is pending.
+    // Returns false if that commit failed.
+    bool append(int number, Money balance, int otherNumber = 0, Money otherBalance = Money()) {
+        Record rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.magic = RECORD_MAGIC;
+        rec.count = otherNumber != 0 ? 2 : 1;
+        rec.number[0] = number;
+        rec.cents[0] = balance.getCents();
+        rec.number[1] = otherNumber;
+        rec.cents[1] = otherBalance.getCents();
+        rec.checksum = crc32(&rec, offsetof(Record, checksum));
+        pending.push_back(rec);
+        return pending.size() < groupSize || commit();
+    }
+
+    // Writes all pending records and makes them durable with one fsync. On failure the log is cut
+    // back to its last durable record, so a partly written group never sits in front of later ones,
+    // and the records stay pending for the next commit. Returns false if they were not saved.
+    bool commit() {
+        if (pending.empty() || fd < 0) {
+            return fd >= 0;
+        }
+        size_t bytes = pending.size() * sizeof(Record);
+        bool written = writeFully(fd, (const char*)pending.data(), bytes);
+#ifdef __linux__
+        written = written && ::fdatasync(fd) == 0;
+#else
+        written = written && ::fsync(fd) == 0;
+#endif
+        if (!written) {
+            if (::ftruncate(fd, durableEnd) != 0) {
+                // The log can no longer be trusted past this point; stop appending to it
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            ::lseek(fd, durableEnd, SEEK_SET);
+            return false;
+        }
+        durableEnd += bytes;
+        pending.clear();
+        return true;
+    }
+
+    // Discards the log once every change in it has been written to the vaults.
+    void truncate() {
+        pending.clear();
+        if (fd >= 0 && ::ftruncate(fd, 0) == 0) {
+            ::lseek(fd, 0, SEEK_SET);
+            ::fsync(fd);
+            durableEnd = 0;
+        }
+    }
+
+    // Commits anything pending and closes the log.
+    void close() {
+        if (fd >= 0) {
+            commit();
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+// --------------------------
+// VaultManifest Class
+// --------------------------
+// The VaultManifest lists every user the vaults hold (role, username, account number), so startup
+// can plan its reads from one sequential file instead of enumerating and stat-ing vault
+// directories. Registrations append to it; it is rewritten whole only when rebuilt from a scan.
+class VaultManifest {
+public:
+    struct Entry {
+        bool isEmployee;
+        int number;            // the user's account number, 0 if none
+        string username;
+    };
+    static constexpr uint64_t MANIFEST_MAGIC = 0x54534E4D4B4E4142ULL; // "BANKMNST"
+    static constexpr uint32_t MANIFEST_VERSION = 1;
+private:
+    int fd = -1;
+
+    // Appends one entry as: payload length, payload, CRC-32 of the payload.
+    static void encode(const Entry& entry, ByteWriter& out) {
+        ByteWriter payload;
+        payload.put<uint8_t>(entry.isEmployee ? 1 : 0);
+        payload.put<int32_t>(entry.number);
+        payload.putString(entry.username);
+        out.put<uint32_t>((uint32_t)payload.bytes.size());
+        out.bytes.insert(out.bytes.end(), payload.bytes.begin(), payload.bytes.end());
+        out.put<uint32_t>(crc32(payload.bytes.data(), payload.bytes.size()));
+    }
+    // Writes bytes at the end of the open manifest and makes them durable.
+    bool writeDurably(const ByteWriter& out) {
+        if (fd < 0 || !writeFully(fd, out.bytes.data(), out.bytes.size())) {
+            return false;
+        }
+#ifdef __linux__
+        return ::fdatasync(fd) == 0;
+#else
+        return ::fsync(fd) == 0;
+#endif
+    }
+public:
+    VaultManifest() {}
+    VaultManifest(const VaultManifest&) = delete;
+    VaultManifest& operator=(const VaultManifest&) = delete;
+    ~VaultManifest() {
+        close();
+    }
+
+    // Reads every entry from the manifest at path and opens it for appending. Returns false, leaving
+    // it closed, if there is no manifest there or any part of it is damaged: a torn append may have
+    // been followed by vault writes the manifest never recorded, so only a rescan can be trusted.
+    bool open(const string& path, vector<Entry>& entries) {
+        close();
+        entries.clear();
+        int file = ::open(path.c_str(), O_RDWR);
+        struct stat st;
+        if (file < 0 || ::fstat(file, &st) != 0) {
+            if (file >= 0) {
+                ::close(file);
+            }
+            return false;
+        }
+        vector<char> bytes(st.st_size);
+        if (::pread(file, bytes.data(), bytes.size(), 0) != (ssize_t)bytes.size()) {
+            ::close(file);
+            return false;
+        }
+        ByteReader in(bytes.data(), bytes.size());
+        if (in.get<uint64_t>() != MANIFEST_MAGIC || in.get<uint32_t>() != MANIFEST_VERSION || !in.ok()) {
+            cout << "Manifest " << path << " is damaged; rebuilding it from the vaults.\n";
+            ::close(file);
+            return false;
+        }
+        size_t good = in.p - bytes.data();
+        while (true) {
+            uint32_t len = in.get<uint32_t>();
+            if (!in.ok() || (size_t)(in.end - in.p) < (size_t)len + sizeof(uint32_t)) {
+                break;
+            }
+            ByteReader payload(in.p, len);
+            in.p += len;
+            if (in.get<uint32_t>() != crc32(payload.p, len)) {
+                break;
+            }
+            Entry entry;
+            entry.isEmployee = payload.get<uint8_t>() != 0;
+            entry.number = payload.get<int32_t>();
+            entry.username = payload.getString();
+            if (!payload.ok()) {
+                break;
+            }
+            entries.push_back(entry);
+            good = in.p - bytes.data();
+        }
+        if (good != bytes.size()) {
+            cout << "Manifest " << path << " is damaged; rebuilding it from the vaults.\n";
+            ::close(file);
+            return false;
+        }
+        ::lseek(file, good, SEEK_SET);
+        fd = file;
+        return true;
+    }
+
+    // Replaces the manifest at path with exactly these entries and opens it for appending.
+    bool rewrite(const string& path, const vector<Entry>& entries) {
+        close();
+        ByteWriter out;
+        out.put<uint64_t>(MANIFEST_MAGIC);
+        out.put<uint32_t>(MANIFEST_VERSION);
+        for (const auto& entry : entries) {
+            encode(entry, out);
+        }
+        string tempName = path + ".tmp";
+        fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!writeDurably(out) || ::rename(tempName.c_str(), path.c_str()) != 0) {
+            cout << "Unable to write manifest " << path << '\n';
+            close();
+            ::unlink(tempName.c_str());
+            return false;
+        }
+        syncDirectory(fs::path(path).parent_path().string());
+        return true;
+    }
+
+    // Appends entries for newly registered users and makes them durable with one fsync.
+    bool append(const vector<Entry>& entries) {
+        ByteWriter out;
+        for (const auto& entry : entries) {
+            encode(entry, out);
+        }
+        return writeDurably(out);
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+// --------------------------
+// AccountTable Class
+// --------------------------
+// The AccountTable is a file of fixed-size account records mapped into memory with mmap, kept in
+// account number order and followed by an open-addressing index of their number hashes. Lookups
+// search the mapping directly, so opening the table reads nothing per record and the OS page
+// cache decides what stays resident. Accounts bound to a record update its balance in place.
+class AccountTable {
+public:
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t count;        // records in use
+        uint64_t capacity;     // records the file has room for
+        BYTE reserved[32];
+    };
+    // Owner names longer than OWNER_LEN - 1 bytes are truncated in the table.
+    static constexpr size_t OWNER_LEN = 80;
+    struct Record {
+        int32_t number;
+        uint32_t reserved;
+        Money balance;
+        Digest numberHash;     // sha256 of the account number, for customer lookups
+        char owner[OWNER_LEN]; // NUL-padded owner name
+    };
+    static_assert(sizeof(Header) == 64 && sizeof(Record) == 128, "account table layout is fixed on disk");
+    static constexpr uint64_t TABLE_MAGIC = 0x4C42544154434341ULL; // "ACCTATBL"
+    static constexpr uint32_t TABLE_VERSION = 2;
+private:
+    int fd = -1;
+    char* base = nullptr;
+    size_t mappedBytes = 0;
+
+    Header& header() { return *(Header*)base; }
+    const Header& header() const { return *(const Header*)base; }
+    // Slots in the hash index of a table with room for capacity records: a power of two at least
+    // twice the capacity, so probe runs stay short. Each slot holds a record position + 1 (0 = empty).
+    static size_t slotCount(size_t capacity) {
+        size_t slots = 64;
+        while (slots < capacity * 2) {
+            slots *= 2;
+        }
+        return slots;
+    }
+    // Bytes in a table file with room for capacity records.
+    static size_t fileSize(size_t capacity) {
+        return sizeof(Header) + capacity * sizeof(Record) + slotCount(capacity) * sizeof(uint32_t);
+    }
+    // The hash index, which follows the records of a table with room for capacity records.
+    uint32_t* slots(size_t capacity) const { return (uint32_t*)(base + sizeof(Header) + capacity * sizeof(Record)); }
+    // Starting slot for a number hash; SHA-256 output is already uniform, so its first bytes do.
+    static size_t slotFor(const Digest& hash, size_t capacity) {
+        uint64_t bits;
+        memcpy(&bits, hash.bytes, sizeof(bits));
+        return (size_t)bits & (slotCount(capacity) - 1);
+    }
+    // Adds record i to the hash index of a table with room for capacity records.
+    void indexRecord(size_t i, size_t capacity) {
+        uint32_t* index = slots(capacity);
+        size_t mask = slotCount(capacity) - 1;
+        size_t slot = slotFor(record(i).numberHash, capacity);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot] = (uint32_t)(i + 1);
+    }
+    // Maps the first bytes of the open file, replacing any previous mapping only once the new one
+    // is in place.
+    bool map(size_t bytes) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        if (base != nullptr) {
+            munmap(base, mappedBytes);
+        }
+        base = (char*)p;
+        mappedBytes = bytes;
+        return true;
+    }
+public:
+    AccountTable() {}
+    AccountTable(const AccountTable&) = delete;
+    AccountTable& operator=(const AccountTable&) = delete;
+    ~AccountTable() {
+        close();
+    }
+
+    // Maps an existing table; returns false if it is missing or not a valid table.
+    bool open(const string& path) {
+        close();
+        fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header) || !map((size_t)st.st_size)) {
+            close();
+            return false;
+        }
+        const Header& h = header();
+        if (h.magic != TABLE_MAGIC || h.version != TABLE_VERSION || h.recordSize != sizeof(Record)
+            || h.count > h.capacity || fileSize(h.capacity) > (size_t)st.st_size) {
+            cout << "Account table " << path << " is damaged; rebuilding it from the vaults.\n";
+            close();
+            return false;
+        }
+        return true;
+    }
+    // Creates (or replaces) an empty table with room for capacity records and maps it.
+    bool create(const string& path, size_t capacity) {
+        close();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        size_t bytes = fileSize(capacity);
+        if (::ftruncate(fd, bytes) != 0 || !map(bytes)) {
+            close();
+            return false;
+        }
+        Header& h = header();
+        h.magic = TABLE_MAGIC;
+        h.version = TABLE_VERSION;
+        h.recordSize = sizeof(Record);
+        h.count = 0;
+        h.capacity = capacity;
+        return true;
+    }
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return base != nullptr ? (size_t)header().count : 0; }
+    Record& record(size_t i) { return ((Record*)(base + sizeof(Header)))[i]; }
+    const Record& record(size_t i) const { return ((const Record*)(base + sizeof(Header)))[i]; }
+    // Returns a record's owner name.
+    static string ownerName(const Record& rec) { return string(rec.owner, strnlen(rec.owner, OWNER_LEN)); }
+
+    // Finds the record for an account number by binary search. Returns false if there is none.
+    bool findNumber(int number, size_t& pos) const {
+        size_t lo = 0;
+        size_t hi = size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (record(mid).number < number) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        pos = lo;
+        return lo < size() && record(lo).number == number;
+    }
+    // Finds the record whose account number hashes to numberHash. Returns false if there is none.
+    bool findHash(const Digest& numberHash, size_t& pos) const {
+        size_t capacity = (size_t)header().capacity;
+        const uint32_t* index = slots(capacity);
+        size_t mask = slotCount(capacity) - 1;
+        // A slot left by an append that never published its record points past the end; skip it
+        for (size_t slot = slotFor(numberHash, capacity); index[slot] != 0; slot = (slot + 1) & mask) {
+            pos = index[slot] - 1;
+            if (pos < size() && record(pos).numberHash == numberHash) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Appends a record, doubling the file when full. Numbers must be appended in increasing order.
+    // Returns false if the number is out of order or the file could not grow. Growing remaps the
+    // table, so every pointer into it must be re-fetched afterwards.
+    bool append(int number, const string& owner, Money balance, const Digest& numberHash, bool& remapped) {
+        remapped = false;
+        size_t count = size();
+        if (count > 0 && number <= record(count - 1).number) {
+            return false;
+        }
+        if (count == header().capacity) {
+            size_t capacity = header().capacity * 2 + 64;
+            if (::ftruncate(fd, fileSize(capacity)) != 0 || !map(fileSize(capacity))) {
+                return false;
+            }
+            remapped = true;
+            // Build the larger index past the new record space, then switch to it by publishing
+            // the new capacity
+            memset(slots(capacity), 0, slotCount(capacity) * sizeof(uint32_t));
+            for (size_t i = 0; i < count; i++) {
+                indexRecord(i, capacity);
+            }
+            header().capacity = capacity;
+        }
+        Record& rec = record(count);
+        memset((void*)&rec, 0, sizeof(rec));
+        rec.number = number;
+        rec.balance = balance;
+        rec.numberHash = numberHash;
+        strncpy(rec.owner, owner.c_str(), OWNER_LEN - 1);
+        indexRecord(count, (size_t)header().capacity);
+        // Publish the record only after it is fully written and indexed
+        header().count++;
+        return true;
+    }
+    // Flushes every in-place update to the file.
+    void sync() {
+        if (base != nullptr) {
+            msync(base, mappedBytes, MS_SYNC);
+        }
+    }
+    void close() {
+        if (base != nullptr) {
+            munmap(base, mappedBytes);
+            base = nullptr;
+            mappedBytes = 0;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+// --------------------------
+// Bank Class
+// --------------------------
+// The Bank class manages accounts, customers, and employees, and handles persistence.
+class Bank {
+private:
+    vector<Account> account;
+    // Maps account number to its position in the account vector.
+    unordered_map<int, size_t> accountIndex;
+    // Maps the SHA-256 of an account number (as stored in customer profiles) to its position.
+    unordered_map<Digest, size_t> accountHashIndex;
+    int nextAccountNumber = 1000;
+    vector<Customer> customers;
+    vector<Employee> employees;
+    // Map usernames to positions in the customer and employee vectors.
+    unordered_map<string, size_t> customerIndex;
+    unordered_map<string, size_t> employeeIndex;
+    // Identifies the user whose vault directory holds an account's account.json.
+    struct AccountOwner {
+        bool isEmployee;
+        size_t index;
+    };
+    // Maps account number to the user whose vault stores it.
+    unordered_map<int, AccountOwner> accountOwners;
+    // Records changed since the last save; only these are written by saveUsersToFile.
+    unordered_set<size_t> dirtyCustomers;
+    unordered_set<size_t> dirtyEmployees;
+    unordered_set<int> dirtyAccounts;
+    // Write-ahead log of balance changes not yet checkpointed into the vaults.
+    TransactionLog transactionLog;
+    // Snapshot last loaded or saved; removed once registrations make it stale.
+    string snapshotFile;
+    static constexpr uint64_t SNAPSHOT_MAGIC = 0x50414E534B4E4142ULL; // "BANKSNAP"
+    static constexpr uint32_t SNAPSHOT_VERSION = 2;
+    // Memory-mapped account table; when open, it is the source of every account and balance, and
+    // the account vector and its indexes stay empty.
+    AccountTable accountTable;
+    // Accounts copied out of the account table on first use, by record position; their balances
+    // stay in the table. Records never used are never copied.
+    unordered_map<size_t, Account> mappedAccounts;
+    // The table lives at a fixed path so runs without it can still invalidate it.
+    const string accountTableFile = "vaults/accounts.tbl";
+    // Encoding saveUsersToFile writes vault files in; the loader accepts any of them.
+    VaultFormat vaultFormat = VaultFormat::Compact;
+    // Number of worker threads loadUsersFromFile parses vault directories with.
+    unsigned loadThreads = max(1u, thread::hardware_concurrency());
+    // One vault directory as parsed by a load worker, before it is merged into the bank.
+    struct VaultEntry {
+        bool hasProfile = false;
+        string username;
+        Digest password;
+        Digest accountHash;
+        bool hasAccount = false;
+        string name;
+        int number = 0;
+        Money balance;
+        bool damaged = false;
+    };
+    // Lazy mode: customers stay on disk until their first login or first use as a transfer target.
+    bool lazyVaults = false;
+    // Customer vault directories not loaded yet, by username; this is all lazy startup reads.
+    unordered_set<string> unloadedCustomers;
+    // Whether nextAccountNumber already accounts for the vaults of unloaded customers.
+    bool nextAccountNumberKnown = true;
+    // Most customers kept loaded in lazy mode (0 = no limit); the least recently used are evicted.
+    size_t customerCacheLimit = 0;
+    // Loaded customers from most to least recently used, and each one's place in that list.
+    list<string> customerLru;
+    unordered_map<string, list<string>::iterator> customerLruPos;
+    // Customers in use by a session, which are never evicted.
+    unordered_map<string, int> customerPins;
+    // Hashed fan-out of vaults/customers: 0 keeps user directories directly under it; N nests
+    // them under N levels of two-hex-digit buckets taken from the SHA-256 of the username.
+    int customerFanout = 0;
+    // Records the fan-out of vaults/customers, so every run uses the layout on disk.
+    const string customerLayoutFile = "vaults/customers/layout.json";
+    // Lists every user in the vaults; open only while it is known to be complete.
+    VaultManifest manifest;
+    const string manifestFile = "vaults/manifest.bin";
+    // Lazy mode: the username owning each customer account, from the manifest, for transfer lookups.
+    unordered_map<int, string> customerByAccount;
+    // Why the last save failed; saves run on server threads, so the front end reports it.
+    string saveError;
+    // Reads an account balance from its vault record: integer cents, or legacy floating-point dollars.
+    static Money readBalance(const VaultRecord& ar) {
+        Money balance;
+        if (ar.hasBalanceCents) {
+            balance = Money(ar.balanceCents);
+        } else {
+            Money::fromDollars(ar.balance, balance);
+        }
+        return balance;
+    }
+    // Appends an account to the vector and records its position in the number index.
+    // The caller must follow up with indexAccountHashes to make it reachable by hash.
+    void insertAccount(const Account& acc) {
+        accountIndex[acc.getAccountNumber()] = account.size();
+        account.push_back(acc);
+    }
+    // Returns the Account for account table record i, copying it out of the table on first use.
+    Account& mappedAccount(size_t i) {
+        auto it = mappedAccounts.find(i);
+        if (it == mappedAccounts.end()) {
+            AccountTable::Record& rec = accountTable.record(i);
+            it = mappedAccounts.emplace(i, Account(AccountTable::ownerName(rec), rec.number, rec.balance)).first;
+            it->second.mapBalance(&rec.balance);
+        }
+        return it->second;
+    }
+    // Finds a loaded account by number without loading or touching anything; nullptr if not found.
+    Account* accountByNumber(int number) {
+        size_t pos;
+        if (accountTable.isOpen()) {
+            return accountTable.findNumber(number, pos) ? &mappedAccount(pos) : nullptr;
+        }
+        auto it = accountIndex.find(number);
+        return it != accountIndex.end() ? &account[it->second] : nullptr;
+    }
+    // Returns the number of the loaded account whose number hashes to accountHash, or 0 if there
+    // is none. Unlike findAccountByHash, never copies an account out of the account table.
+    int accountNumberByHash(const Digest& accountHash) const {
+        size_t pos;
+        if (accountTable.isOpen()) {
+            return accountTable.findHash(accountHash, pos) ? accountTable.record(pos).number : 0;
+        }
+        auto it = accountHashIndex.find(accountHash);
+        return it != accountHashIndex.end() ? account[it->second].getAccountNumber() : 0;
+    }
+
+    // Empties every account, user, index and pending change before a load.
+    // Accounts served from an open account table are kept; they do not come from the loaders.
+    void clearAll() {
+        if (!accountTable.isOpen()) {
+            account.clear();
+            accountIndex.clear();
+            accountHashIndex.clear();
+            nextAccountNumber = 1000;
+        }
+        accountOwners.clear();
+        customers.clear();
+        customerIndex.clear();
+        employees.clear();
+        employeeIndex.clear();
+        dirtyCustomers.clear();
+        dirtyEmployees.clear();
+        dirtyAccounts.clear();
+        unloadedCustomers.clear();
+        customerByAccount.clear();
+        customerLru.clear();
+        customerLruPos.clear();
+        nextAccountNumberKnown = true;
+    }
+    // Links each loaded customer to its account and clears the dirty sets the loaders' add calls filled.
+    void finishLoad() {
+        for (size_t i = 0; i < customers.size(); i++) {
+            int number = accountNumberByHash(customers[i].getAccountHash());
+            if (number != 0) {
+                accountOwners[number] = {false, i};
+            }
+        }
+        // Everything just came from disk, so nothing needs saving yet
+        dirtyCustomers.clear();
+        dirtyEmployees.clear();
+        dirtyAccounts.clear();
+    }
+    // Points every account copied out of the account table back at its record, after growing the
+    // table remapped it.
+    void bindAccountTable() {
+        for (auto& entry : mappedAccounts) {
+            entry.second.mapBalance(&accountTable.record(entry.first).balance);
+        }
+    }
+    // Marks a loaded customer as the most recently used (lazy mode only).
+    void touchCustomer(const string& username) {
+        if (!lazyVaults) {
+            return;
+        }
+        auto pos = customerLruPos.find(username);
+        if (pos != customerLruPos.end()) {
+            customerLru.splice(customerLru.begin(), customerLru, pos->second);
+        } else {
+            customerLru.push_front(username);
+            customerLruPos[username] = customerLru.begin();
+        }
+    }
+    // Reads only the account number from a vault directory's account.json; false if it has none.
+    static bool readVaultAccountNumber(const fs::path& dir, int& number) {
+        VaultRecord ar;
+        if (!readVaultRecord(dir.string() + "/account.json", ar)) {
+            return false;
+        }
+        number = (int)ar.number;
+        return true;
+    }
+    // Loads an unloaded customer and their account from the vault. Returns false if the customer
+    // has no vault waiting to be loaded. Never evicts, so callers decide when to trim the cache.
+    bool loadCustomerVault(const string& username) {
+        auto it = unloadedCustomers.find(username);
+        if (it == unloadedCustomers.end()) {
+            return false;
+        }
+        unloadedCustomers.erase(it);
+        fs::path dir = customerVaultDir(username);
+        VaultEntry ve;
+        readVaultEntry(dir, true, ve);
+        if (ve.damaged) {
+            cout << "Vault " << dir.string() << " is damaged; skipping the unreadable file.\n";
+        }
+        if (!ve.hasProfile) {
+            return false;
+        }
+        if (ve.hasAccount && accountIndex.count(ve.number) == 0) {
+            insertAccount(Account(ve.name, ve.number, ve.balance));
+            indexAccountHashes(account.size() - 1);
+            if (ve.number >= nextAccountNumber) {
+                nextAccountNumber = ve.number + 1;
+            }
+        }
+        size_t idx = customers.size();
+        addCustomer(Customer(ve.username, ve.password, ve.accountHash));
+        // It came straight from disk, so there is nothing to save
+        dirtyCustomers.erase(idx);
+        if (ve.hasAccount) {
+            dirtyAccounts.erase(ve.number);
+        }
+        touchCustomer(username);
+        return true;
+    }
+    // Finds the unloaded customer whose vault holds an account and loads them. Lazy mode keeps no
+    // account-number index, so this reads each unloaded account.json until it finds the number.
+    bool loadAccountOwner(int number) {
+        auto known = customerByAccount.find(number);
+        if (known != customerByAccount.end()) {
+            string owner = known->second;
+            return loadCustomerVault(owner);
+        }
+        // A complete manifest lists every account, so there is nothing left to scan for
+        if (manifest.isOpen()) {
+            return false;
+        }
+        for (const string& username : unloadedCustomers) {
+            int vaultNumber = 0;
+            if (readVaultAccountNumber(customerVaultDir(username), vaultNumber) && vaultNumber == number) {
+                string owner = username;
+                return loadCustomerVault(owner);
+            }
+        }
+        return false;
+    }
+    // Raises nextAccountNumber past every unloaded customer's account (lazy mode reads their
+    // account.json files once, on the first registration).
+    void resolveNextAccountNumber() {
+        for (const string& username : unloadedCustomers) {
+            int number = 0;
+            if (readVaultAccountNumber(customerVaultDir(username), number) && number >= nextAccountNumber) {
+                nextAccountNumber = number + 1;
+            }
+        }
+        nextAccountNumberKnown = true;
+    }
+    // Writes a fresh manifest listing every customer and employee, loaded or not. In lazy mode this
+    // reads each unloaded customer's account number, which also settles nextAccountNumber.
+    void rebuildManifest() {
+        vector<VaultManifest::Entry> entries;
+        for (const auto& c : customers) {
+            entries.push_back({false, accountNumberByHash(c.getAccountHash()), c.getUsername()});
+        }
+        vector<string> unloaded(unloadedCustomers.begin(), unloadedCustomers.end());
+        sort(unloaded.begin(), unloaded.end());
+        for (const string& username : unloaded) {
+            int number = 0;
+            if (readVaultAccountNumber(customerVaultDir(username), number)) {
+                customerByAccount[number] = username;
+                if (number >= nextAccountNumber) {
+                    nextAccountNumber = number + 1;
+                }
+            }
+            entries.push_back({false, number, username});
+        }
+        nextAccountNumberKnown = true;
+        vector<int> employeeAccount(employees.size(), 0);
+        for (const auto& owner : accountOwners) {
+            if (owner.second.isEmployee) {
+                employeeAccount[owner.second.index] = owner.first;
+            }
+        }
+        for (size_t i = 0; i < employees.size(); i++) {
+            entries.push_back({true, employeeAccount[i], employees[i].getUsername()});
+        }
+        fs::create_directories(fs::path(manifestFile).parent_path());
+        manifest.rewrite(manifestFile, entries);
+    }
+    // Removes the account with the given number by moving the last account into its place.
+    void removeAccount(int number) {
+        auto pos = accountIndex.find(number);
+        size_t idx = pos->second;
+        accountIndex.erase(pos);
+        accountHashIndex.erase(sha256_digest(to_string(number)));
+        accountOwners.erase(number);
+        size_t last = account.size() - 1;
+        if (idx != last) {
+            account[idx] = account[last];
+            accountIndex[account[idx].getAccountNumber()] = idx;
+            accountHashIndex[sha256_digest(to_string(account[idx].getAccountNumber()))] = idx;
+        }
+        account.pop_back();
+    }
+    // Removes the customer at idx by moving the last customer into its place.
+    void removeCustomer(size_t idx) {
+        customerIndex.erase(customers[idx].getUsername());
+        size_t last = customers.size() - 1;
+        if (idx != last) {
+            customers[idx] = customers[last];
+            customerIndex[customers[idx].getUsername()] = idx;
+            if (dirtyCustomers.erase(last) > 0) {
+                dirtyCustomers.insert(idx);
+            }
+            int number = accountNumberByHash(customers[idx].getAccountHash());
+            if (number != 0) {
+                accountOwners[number] = {false, idx};
+            }
+        }
+        customers.pop_back();
+    }
+    // Drops a loaded customer and their account back to disk, first writing an unsaved balance to
+    // account.json (the transaction log still covers it until the next checkpoint). Refuses pinned
+    // customers, newly registered ones whose profile is not saved yet, and any whose balance
+    // cannot be written.
+    bool evictCustomer(const string& username) {
+        auto pos = customerIndex.find(username);
+        if (customerPins.count(username) > 0 || pos == customerIndex.end() || dirtyCustomers.count(pos->second) > 0) {
+            return false;
+        }
+        size_t idx = pos->second;
+        const Account* acc = findAccountByHash(customers[idx].getAccountHash());
+        // Write out an unsaved balance now instead of keeping the customer loaded
+        if (acc != nullptr && dirtyAccounts.count(acc->getAccountNumber()) > 0) {
+            VaultWriteBatch batch("vaults");
+            writeAccountFile(batch, *acc, customerVaultDir(username));
+            if (!batch.commit()) {
+                return false;
+            }
+            dirtyAccounts.erase(acc->getAccountNumber());
+        }
+        if (acc != nullptr) {
+            removeAccount(acc->getAccountNumber());
+        }
+        removeCustomer(idx);
+        unloadedCustomers.insert(username);
+        return true;
+    }
+    // Adds acc's account.json in ownerDir to batch.
+    void writeAccountFile(VaultWriteBatch& batch, const Account& acc, const string& ownerDir) const {
+        nlohmann::json aj = {
+            {"name", acc.getOwnerName()},
+            {"number", acc.getAccountNumber()},
+            {"balanceCents", acc.getBalance().getCents()}
+        };
+        batch.write(ownerDir + "/account.json", aj, vaultFormat);
+    }
+    // Evicts least recently used customers until the cache limit is met, skipping any that cannot
+    // be evicted and always keeping the most recent one, which the caller is about to use.
+    // Pointers to customers and accounts do not survive this.
+    void evictColdCustomers() {
+        if (!lazyVaults || customerCacheLimit == 0 || customerLru.empty()) {
+            return;
+        }
+        auto it = customerLru.end();
+        while (customerLru.size() > customerCacheLimit && --it != customerLru.begin()) {
+            if (evictCustomer(*it)) {
+                customerLruPos.erase(*it);
+                it = customerLru.erase(it);
+            }
+        }
+    }
+    // Hashes the account numbers of account[first..] in one batch and adds them to the hash index.
+    void indexAccountHashes(size_t first) {
+        vector<string> numbers;
+        numbers.reserve(account.size() - first);
+        for (size_t i = first; i < account.size(); i++) {
+            numbers.push_back(to_string(account[i].getAccountNumber()));
+        }
+        vector<Digest> hashes = sha256_many(numbers);
+        for (size_t i = 0; i < hashes.size(); i++) {
+            accountHashIndex[hashes[i]] = first + i;
+        }
+    }
+public:
+    // Returns true if username can name a vault directory: not empty, no path separators,
+    // whitespace or control characters, not starting with '.' (which also rules out . and ..),
+    // and not the customer layout file's name.
+    static bool isValidUsername(const string& username) {
+        if (username.empty() || username[0] == '.' || username == "layout.json") {
+            return false;
+        }
+        for (unsigned char c : username) {
+            if (c == '/' || c == '\\' || isspace(c) || iscntrl(c)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Returns true if a customer with this username exists, loaded or not.
+    bool hasCustomer(const string& username) const {
+        return customerIndex.count(username) > 0 || unloadedCustomers.count(username) > 0;
+    }
+    // Returns true if an employee with this username exists.
+    bool hasEmployee(const string& username) const {
+        return employeeIndex.count(username) > 0;
+    }
+    // Describes why the last saveUsersToFile or checkpoint call failed.
+    const string& lastSaveError() const {
+        return saveError;
+    }
+    // Adds a customer to the bank and marks it (and its account, if already added) for saving.
+    // The username must not be taken (see hasCustomer).
+    void addCustomer(const Customer& customer) {
+        unloadedCustomers.erase(customer.getUsername());
+        touchCustomer(customer.getUsername());
+        customerIndex[customer.getUsername()] = customers.size();
+        dirtyCustomers.insert(customers.size());
+        int number = accountNumberByHash(customer.getAccountHash());
+        if (number != 0) {
+            accountOwners[number] = {false, customers.size()};
+            dirtyAccounts.insert(number);
+        }
+        customers.push_back(customer);
+    }
+    // Adds an employee to the bank and marks it for saving. The username must not be taken.
+    void addEmployee(const Employee& employee) {
+        employeeIndex[employee.getUsername()] = employees.size();
+        dirtyEmployees.insert(employees.size());
+        employees.push_back(employee);
+    }
+    // Records the new balance(s) after a deposit, withdrawal or transfer: appends them to the
+    // transaction log as one record and marks the accounts for the next save. Returns false if
+    // the log could not be written; the change stays pending for the next commit or checkpoint.
+    bool recordTransaction(const Account& acc, const Account* other = nullptr) {
+        dirtyAccounts.insert(acc.getAccountNumber());
+        if (other != nullptr) {
+            dirtyAccounts.insert(other->getAccountNumber());
+            return transactionLog.append(acc.getAccountNumber(), acc.getBalance(),
+                                         other->getAccountNumber(), other->getBalance());
+        }
+        return transactionLog.append(acc.getAccountNumber(), acc.getBalance());
+    }
+    // Sets how many transactions share one log fsync (1 = every transaction is durable on return).
+    void setTransactionGroupSize(size_t transactions) {
+        transactionLog.setGroupSize(transactions);
+    }
+    // Makes every recorded transaction durable. Returns false if the log could not be written.
+    bool commitTransactions() {
+        return transactionLog.commit();
+    }
+    // Opens the transaction log and replays it on top of the balances loaded from the vaults.
+    void openTransactionLog(const string& path) {
+        fs::path logPath(path);
+        if (logPath.has_parent_path()) {
+            fs::create_directories(logPath.parent_path());
+        }
+        vector<TransactionLog::Record> records = transactionLog.open(path);
+        // A lazy session recovering from a crash loads every vault so the log can be replayed
+        if (lazyVaults && !records.empty()) {
+            vector<string> unloaded(unloadedCustomers.begin(), unloadedCustomers.end());
+            for (const string& username : unloaded) {
+                loadCustomerVault(username);
+            }
+        }
+        for (const auto& rec : records) {
+            for (uint32_t i = 0; i < rec.count; i++) {
+                Account* acc = accountByNumber(rec.number[i]);
+                if (acc != nullptr) {
+                    acc->restoreBalance(Money(rec.cents[i]));
+                    dirtyAccounts.insert(rec.number[i]);
+                }
+            }
+        }
+    }
+    // Saves every pending change to the vaults and a fresh snapshot, flushes them to disk and
+    // empties the transaction log. Returns false (see lastSaveError) if anything was not saved,
+    // in which case the log is kept.
+    bool checkpoint(const string& snapshotName, const string& customerFile, const string& employeeFile) {
+        // Even if the log cannot be written, the vault save below covers every change in it
+        transactionLog.commit();
+        bool saved = saveUsersToFile(customerFile, employeeFile);
+        // A lazy session holds only some customers, so it cannot write a full snapshot
+        if (!lazyVaults && !saveToFile(snapshotName)) {
+            // The previous snapshot would win over the vaults at the next startup; if it cannot be
+            // removed, keep the log so that replaying it brings that snapshot up to date
+            error_code ec;
+            fs::remove(snapshotName, ec);
+            if (ec) {
+                saveError = "Unable to remove stale snapshot " + snapshotName + ": " + ec.message();
+                saved = false;
+            }
+        }
+        if (accountTable.isOpen()) {
+            accountTable.sync();
+        } else {
+            // Once the log is emptied, a table that missed this run's changes can't catch up
+            error_code ec;
+            fs::remove(accountTableFile, ec);
+            if (ec) {
+                saveError = "Unable to remove stale account table " + accountTableFile + ": " + ec.message();
+                saved = false;
+            }
+        }
+        // Make the snapshot rename and any table removal durable before the log is emptied
+        syncDirectory(fs::path(snapshotName).parent_path().string());
+        // Keep the log if the vaults missed anything; replaying it next time is harmless
+        if (saved) {
+            transactionLog.truncate();
+        }
+        return saved;
+    }
+    // Maps the account table and serves every account from it. Nothing is read per record: lookups
+    // search the mapping and copy out only the accounts they find. Call before loading users.
+    // Returns false if there is no usable table yet; call createAccountTable after loading instead.
+    bool openAccountTable() {
+        if (!accountTable.open(accountTableFile)) {
+            return false;
+        }
+        account.clear();
+        accountIndex.clear();
+        accountHashIndex.clear();
+        mappedAccounts.clear();
+        // Records are in number order, so the last one holds the highest account number
+        size_t count = accountTable.size();
+        nextAccountNumber = count > 0 ? max(1000, accountTable.record(count - 1).number + 1) : 1000;
+        return true;
+    }
+    // Writes every loaded account into a new account table, in number order, and serves them from
+    // it from then on. Leaves the accounts in memory if the table cannot be written.
+    void createAccountTable() {
+        fs::create_directories(fs::path(accountTableFile).parent_path());
+        if (!accountTable.create(accountTableFile, account.size() + 64)) {
+            cout << "Unable to create account table " << accountTableFile << '\n';
+            return;
+        }
+        vector<size_t> order(account.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return account[a].getAccountNumber() < account[b].getAccountNumber();
+        });
+        vector<string> numbers;
+        numbers.reserve(account.size());
+        for (size_t i : order) {
+            numbers.push_back(to_string(account[i].getAccountNumber()));
+        }
+        vector<Digest> hashes = sha256_many(numbers);
+        for (size_t i = 0; i < order.size(); i++) {
+            const Account& acc = account[order[i]];
+            bool remapped;
+            if (!accountTable.append(acc.getAccountNumber(), acc.getOwnerName(), acc.getBalance(), hashes[i], remapped)) {
+                cout << "Unable to create account table " << accountTableFile << '\n';
+                accountTable.close();
+                error_code ec;
+                fs::remove(accountTableFile, ec);
+                return;
+            }
+        }
+        account.clear();
+        accountIndex.clear();
+        accountHashIndex.clear();
+        mappedAccounts.clear();
+    }
+    // Returns the customer with the given username and password, or nullptr if the login is invalid.
+    // In lazy mode the customer's vault is loaded here on first login.
+    const Customer* loginCustomer(const string& username, const string& password) {
+        if (lazyVaults && loadCustomerVault(username)) {
+            evictColdCustomers();
+        }
+        auto it = customerIndex.find(username);
+        if (it != customerIndex.end() && customers[it->second].checkPassword(password)) {
+            touchCustomer(username);
+            return &customers[it->second];
+        }
+        return nullptr;
+    }
+    // Keeps a customer loaded while a session uses them (lazy mode); pins nest.
+    void pinCustomer(const string& username) {
+        customerPins[username]++;
+    }
+    // Releases a pin taken by pinCustomer.
+    void unpinCustomer(const string& username) {
+        auto it = customerPins.find(username);
+        if (it != customerPins.end() && --it->second <= 0) {
+            customerPins.erase(it);
+            evictColdCustomers();
+        }
+    }
+    // Switches to lazy loading: loadUsersFromFile then indexes customer usernames only, and at most
+    // cacheLimit customers (0 = no limit) stay loaded at once.
+    void enableLazyVaults(size_t cacheLimit) {
+        lazyVaults = true;
+        customerCacheLimit = cacheLimit;
+    }
+    // Returns the employee with the given username and password, or nullptr if the login is invalid.
+    const Employee* loginEmployee(const string& username, const string& password) const {
+        auto it = employeeIndex.find(username);
+        if (it != employeeIndex.end() && employees[it->second].checkPassword(password)) {
+            return &employees[it->second];
+        }
+        return nullptr;
+    }
+    // Returns a const reference to the list of customers.
+    const vector<Customer>& getCustomers() const {
+        return customers;
+    }
+    // Returns a const reference to the list of employees.
+    const vector<Employee>& getEmployees() const {
+        return employees;
+    }
+    // Adds a new account with the given name and initial deposit, returns new account number,
+    // or -1 (adding nothing) if the account table could not grow to hold it.
+    int addAccount(const string& name, Money initialDeposit) {
+        if (!nextAccountNumberKnown) {
+            resolveNextAccountNumber();
+        }
+        int newAccountNumber = nextAccountNumber;
+        Digest numberHash = sha256_digest(to_string(newAccountNumber));
+        if (accountTable.isOpen()) {
+            bool remapped;
+            if (!accountTable.append(newAccountNumber, name, initialDeposit, numberHash, remapped)) {
+                cout << "Unable to grow account table " << accountTableFile << '\n';
+                return -1;
+            }
+            if (remapped) {
+                bindAccountTable();
+            }
+        } else {
+            accountHashIndex[numberHash] = account.size();
+            insertAccount(Account(name, newAccountNumber, initialDeposit));
+        }
+        nextAccountNumber++;
+        return newAccountNumber;
+    }
+    // Finds and returns a pointer to an account by account number, or nullptr if not found.
+    // In lazy mode an unloaded owner is loaded first, which can move other accounts in memory.
+    Account* findAccount(int accountNum) {
+        Account* acc = accountByNumber(accountNum);
+        if (acc == nullptr && lazyVaults && loadAccountOwner(accountNum)) {
+            evictColdCustomers();
+            acc = accountByNumber(accountNum);
+        }
+        if (acc != nullptr) {
+            auto owner = accountOwners.find(accountNum);
+            if (owner != accountOwners.end() && !owner->second.isEmployee) {
+                touchCustomer(customers[owner->second.index].getUsername());
+            }
+        }
+        return acc;
+    }
+    // Finds an account by the hash of its account number, or nullptr if not found.
+    Account* findAccountByHash(const Digest& accountHash) {
+        size_t pos;
+        if (accountTable.isOpen()) {
+            return accountTable.findHash(accountHash, pos) ? &mappedAccount(pos) : nullptr;
+        }
+        auto it = accountHashIndex.find(accountHash);
+        if (it != accountHashIndex.end()) {
+            return &account[it->second];
+        }
+        return nullptr;
+    }
+    // Calls visit(const Account&) for every account in the bank.
+    template <typename Visit>
+    void visitAllAccounts(Visit visit) const {
+        for (size_t i = 0; i < accountTable.size(); i++) {
+            const AccountTable::Record& rec = accountTable.record(i);
+            visit(Account(AccountTable::ownerName(rec), rec.number, rec.balance));
+        }
+        for (size_t i = 0; i < account.size(); i++) {
+            visit(account[i]);
+        }
+        // In lazy mode, customers still on disk are read straight from their vaults
+        vector<string> unloaded(unloadedCustomers.begin(), unloadedCustomers.end());
+        sort(unloaded.begin(), unloaded.end());
+        for (const string& username : unloaded) {
+            VaultEntry ve;
+            readVaultEntry(customerVaultDir(username), true, ve);
+            if (ve.hasAccount) {
+                visit(Account(ve.name, ve.number, ve.balance));
+            }
+        }
+    }
+    // Displays all accounts in the bank.
+    void showAllAccounts() const {
+        visitAllAccounts([](const Account& acc) { acc.display(); });
+    }
+    // Returns a const reference to the accounts held in memory (none while the account table is
+    // open; use visitAllAccounts to see every account).
+    const vector<Account>& getAllAccounts() const {
+        return account;
+    }
+    // Writes every account, customer and employee to a single binary snapshot file.
+    // Layout: header, account records (none while the account table holds them), customer records,
+    // employee records, then a CRC-32 of everything before it. The file is written to a temporary
+    // name and renamed into place.
+    // Returns false if the snapshot could not be written.
+    bool saveToFile(const string& filename) {
+        ByteWriter out;
+        out.put<uint64_t>(SNAPSHOT_MAGIC);
+        out.put<uint32_t>(SNAPSHOT_VERSION);
+        out.put<int32_t>(nextAccountNumber);
+        // With the account table open the accounts stay in it, and the snapshot holds only users
+        out.put<uint8_t>(accountTable.isOpen());
+        out.put<uint64_t>(account.size());
+        out.put<uint64_t>(customers.size());
+        out.put<uint64_t>(employees.size());
+        for (const auto& acc : account) {
+            out.put<int32_t>(acc.getAccountNumber());
+            out.put<int64_t>(acc.getBalance().getCents());
+            out.put<Digest>(sha256_digest(to_string(acc.getAccountNumber())));
+            out.putString(acc.getOwnerName());
+        }
+        // Customers carry their account number too, so loading needs no hash lookups to link them
+        for (const auto& c : customers) {
+            out.putString(c.getUsername());
+            out.put<Digest>(c.getPassword());
+            out.put<Digest>(c.getAccountHash());
+            out.put<int32_t>(accountNumberByHash(c.getAccountHash()));
+        }
+        // Employees also carry the number of the account stored in their vault (0 if none)
+        vector<int32_t> employeeAccount(employees.size(), 0);
+        for (const auto& owner : accountOwners) {
+            if (owner.second.isEmployee) {
+                employeeAccount[owner.second.index] = owner.first;
+            }
+        }
+        for (size_t i = 0; i < employees.size(); i++) {
+            out.putString(employees[i].getUsername());
+            out.put<Digest>(employees[i].getPassword());
+            out.put<int32_t>(employeeAccount[i]);
+        }
+        out.put<uint32_t>(crc32(out.bytes.data(), out.bytes.size()));
+
+        string tempName = filename + ".tmp";
+        int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            cout << "Unable to write snapshot " << filename << '\n';
+            return false;
+        }
+        bool written = writeFully(fd, out.bytes.data(), out.bytes.size()) && ::fsync(fd) == 0;
+        ::close(fd);
+        if (!written || ::rename(tempName.c_str(), filename.c_str()) != 0) {
+            cout << "Unable to write snapshot " << filename << '\n';
+            ::unlink(tempName.c_str());
+            return false;
+        }
+        snapshotFile = filename;
+        return true;
+    }
+    // Loads every account, customer and employee from a snapshot written by saveToFile in one read.
+    // Returns false, leaving the bank empty, if the file is missing, from another version, or damaged.
+    bool loadFromFile(const string& filename) {
+        clearAll();
+        ifstream file(filename, ios::binary | ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        vector<char> bytes((size_t)file.tellg());
+        file.seekg(0);
+        file.read(bytes.data(), bytes.size());
+        if (!file || bytes.size() < sizeof(uint32_t)) {
+            cout << "Snapshot " << filename << " is unreadable; loading vaults instead.\n";
+            return false;
+        }
+        size_t bodyLen = bytes.size() - sizeof(uint32_t);
+        uint32_t storedCrc;
+        memcpy(&storedCrc, bytes.data() + bodyLen, sizeof(storedCrc));
+        ByteReader reader(bytes.data(), bodyLen);
+        if (storedCrc != crc32(bytes.data(), bodyLen) || reader.get<uint64_t>() != SNAPSHOT_MAGIC
+            || reader.get<uint32_t>() != SNAPSHOT_VERSION) {
+            cout << "Snapshot " << filename << " is damaged or from another version; loading vaults instead.\n";
+            return false;
+        }
+        int32_t snapshotNextNumber = reader.get<int32_t>();
+        // A snapshot written with the account table open has no accounts; only that table has them
+        bool accountsInTable = reader.get<uint8_t>() != 0;
+        if (accountsInTable && !accountTable.isOpen()) {
+            cout << "Snapshot " << filename << " keeps its accounts in the account table; loading vaults instead.\n";
+            return false;
+        }
+        // With an account table open, accounts come from the table and these records are skipped
+        bool loadAccounts = !accountTable.isOpen();
+        if (loadAccounts) {
+            nextAccountNumber = snapshotNextNumber;
+        }
+        uint64_t accountCount = reader.get<uint64_t>();
+        uint64_t customerCount = reader.get<uint64_t>();
+        uint64_t employeeCount = reader.get<uint64_t>();
+        // Every record is at least 40 bytes, which bounds the counts before reserving
+        if (!reader.ok() || accountCount + customerCount + employeeCount > bodyLen / 40) {
+            clearAll();
+            return false;
+        }
+        if (loadAccounts) {
+            account.reserve(accountCount);
+            accountIndex.reserve(accountCount);
+            accountHashIndex.reserve(accountCount);
+        }
+        for (uint64_t i = 0; i < accountCount && reader.ok(); i++) {
+            int32_t number = reader.get<int32_t>();
+            Money balance(reader.get<int64_t>());
+            Digest numberHash = reader.get<Digest>();
+            string name = reader.getString();
+            if (loadAccounts) {
+                accountHashIndex[numberHash] = account.size();
+                insertAccount(Account(name, number, balance));
+            }
+        }
+        customers.reserve(customerCount);
+        customerIndex.reserve(customerCount);
+        accountOwners.reserve(accountCount);
+        for (uint64_t i = 0; i < customerCount && reader.ok(); i++) {
+            string username = reader.getString();
+            Digest password = reader.get<Digest>();
+            Digest accountHash = reader.get<Digest>();
+            int32_t accountNumber = reader.get<int32_t>();
+            customerIndex[username] = customers.size();
+            if (accountNumber != 0) {
+                accountOwners[accountNumber] = {false, customers.size()};
+            }
+            customers.emplace_back(username, password, accountHash);
+        }
+        for (uint64_t i = 0; i < employeeCount && reader.ok(); i++) {
+            string username = reader.getString();
+            Digest password = reader.get<Digest>();
+            int32_t accountNumber = reader.get<int32_t>();
+            employeeIndex[username] = employees.size();
+            if (accountNumber != 0) {
+                accountOwners[accountNumber] = {true, employees.size()};
+            }
+            employees.emplace_back(username, password);
+        }
+        if (!reader.ok() || reader.p != reader.end) {
+            cout << "Snapshot " << filename << " is damaged; loading vaults instead.\n";
+            clearAll();
+            return false;
+        }
+        snapshotFile = filename;
+        // Registrations append to the manifest, so build a complete one if this vault predates it
+        vector<VaultManifest::Entry> listed;
+        if (!manifest.open(manifestFile, listed)) {
+            rebuildManifest();
+        }
+        return true;
+    }
+    // Parses one vault directory's profile.json and, if wanted, its account.json. Touches no bank state.
+    static void readVaultEntry(const fs::path& dir, bool wantAccount, VaultEntry& out) {
+        // Files are opened directly; only a failed read pays for a stat to tell missing from damaged
+        string profilePath = dir.string() + "/profile.json";
+        VaultRecord pr;
+        error_code ec;
+        if (!readVaultRecord(profilePath, pr)) {
+            out.damaged = fs::exists(profilePath, ec);
+            return;
+        }
+        out.hasProfile = true;
+        out.username = std::move(pr.username);
+        Digest::fromHex(pr.password, out.password);
+        Digest::fromHex(pr.accountNumber, out.accountHash);
+        string accountPath = dir.string() + "/account.json";
+        VaultRecord ar;
+        if (!wantAccount) {
+            return;
+        }
+        if (!readVaultRecord(accountPath, ar)) {
+            out.damaged = fs::exists(accountPath, ec);
+            return;
+        }
+        out.hasAccount = true;
+        out.name = std::move(ar.name);
+        out.number = (int)ar.number;
+        out.balance = readBalance(ar);
+    }
+    // Lists the user directories under dir in name order, so loads merge in the same order every time.
+    static vector<fs::path> listVaultDirs(const string& dir) {
+        vector<fs::path> dirs;
+        if (fs::exists(dir) && fs::is_directory(dir)) {
+            for (const auto& entry : fs::directory_iterator(dir)) {
+                if (fs::is_directory(entry)) {
+                    dirs.push_back(entry.path());
+                }
+            }
+        }
+        sort(dirs.begin(), dirs.end());
+        return dirs;
+    }
+    // Returns a customer's vault directory under the given fan-out, e.g. vaults/customers/ab/cd/alice.
+    static string customerVaultDir(const string& username, int fanout) {
+        string dir = "vaults/customers/";
+        if (fanout > 0) {
+            Digest hash = sha256_digest(username);
+            for (int level = 0; level < fanout; level++) {
+                char bucket[2];
+                hex_encode(&hash.bytes[level], 1, bucket);
+                dir.append(bucket, 2);
+                dir += '/';
+            }
+        }
+        return dir + username;
+    }
+    // Returns a customer's vault directory under the current layout.
+    string customerVaultDir(const string& username) const {
+        return customerVaultDir(username, customerFanout);
+    }
+    // Lists every customer vault directory under the current layout, in path order.
+    vector<fs::path> listCustomerVaultDirs() const {
+        vector<fs::path> dirs = listVaultDirs("vaults/customers");
+        for (int level = 0; level < customerFanout; level++) {
+            vector<fs::path> next;
+            for (const auto& bucket : dirs) {
+                vector<fs::path> children = listVaultDirs(bucket.string());
+                next.insert(next.end(), children.begin(), children.end());
+            }
+            dirs.swap(next);
+        }
+        return dirs;
+    }
+    // Writes layout.json for the current fan-out; the batch flush also makes earlier moves durable.
+    bool writeCustomerLayout() {
+        fs::create_directories("vaults/customers");
+        VaultWriteBatch batch("vaults");
+        batch.write(customerLayoutFile, {{"fanout", customerFanout}}, vaultFormat);
+        if (!batch.commit()) {
+            cout << batch.error() << '\n';
+            return false;
+        }
+        return true;
+    }
+    // Parses dirs into entries, splitting them into one contiguous chunk per worker thread.
+    void readVaultEntries(const vector<fs::path>& dirs, bool wantAccounts, vector<VaultEntry>& entries) const {
+        entries.assign(dirs.size(), VaultEntry());
+        size_t workers = min<size_t>(loadThreads, dirs.size());
+        if (workers <= 1) {
+            for (size_t i = 0; i < dirs.size(); i++) {
+                readVaultEntry(dirs[i], wantAccounts, entries[i]);
+            }
+            return;
+        }
+        vector<thread> pool;
+        size_t chunk = (dirs.size() + workers - 1) / workers;
+        for (size_t first = 0; first < dirs.size(); first += chunk) {
+            size_t last = min(first + chunk, dirs.size());
+            pool.emplace_back([&dirs, &entries, wantAccounts, first, last]() {
+                for (size_t i = first; i < last; i++) {
+                    readVaultEntry(dirs[i], wantAccounts, entries[i]);
+                }
+            });
+        }
+        for (auto& worker : pool) {
+            worker.join();
+        }
+    }
+    // Loads customers and employees from their respective directories (no encryption).
+    // Directories are parsed in parallel and merged in name order on this thread.
+    void loadUsersFromFile(const string& customerFile, const string& employeeFile) {
+        clearAll();
+        // Accounts come from the account table instead when it is open
+        bool loadAccounts = !accountTable.isOpen();
+        // Plan the reads from the manifest; without one, scan the vault directories and rebuild it
+        vector<VaultManifest::Entry> listed;
+        bool planned = manifest.open(manifestFile, listed);
+        vector<fs::path> dirs;
+        vector<fs::path> employeeDirs;
+        if (planned) {
+            // A user listed twice (by a save retried after a failure) is loaded once, from its last entry
+            unordered_map<string, size_t> latest[2];
+            for (size_t i = 0; i < listed.size(); i++) {
+                latest[listed[i].isEmployee][listed[i].username] = i;
+            }
+            for (size_t i = 0; i < listed.size(); i++) {
+                const VaultManifest::Entry& entry = listed[i];
+                if (latest[entry.isEmployee][entry.username] != i) {
+                    continue;
+                }
+                if (entry.isEmployee) {
+                    employeeDirs.push_back("vaults/employees/" + entry.username);
+                } else {
+                    dirs.push_back(customerVaultDir(entry.username));
+                    if (lazyVaults && entry.number != 0) {
+                        customerByAccount[entry.number] = entry.username;
+                    }
+                }
+                if (lazyVaults && entry.number >= nextAccountNumber) {
+                    nextAccountNumber = entry.number + 1;
+                }
+            }
+        } else {
+            dirs = listCustomerVaultDirs();
+            employeeDirs = listVaultDirs("vaults/employees");
+        }
+        // Load customers from vaults/customers/[username]/profile.json and account.json
+        vector<VaultEntry> entries;
+        if (lazyVaults) {
+            // Only the usernames are read now; each vault is loaded on first use
+            for (const auto& dir : dirs) {
+                unloadedCustomers.insert(dir.filename().string());
+            }
+            nextAccountNumberKnown = planned || unloadedCustomers.empty();
+        } else {
+            readVaultEntries(dirs, loadAccounts, entries);
+        }
+        customers.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            const VaultEntry& ve = entries[i];
+            if (ve.damaged) {
+                cout << "Vault " << dirs[i].string() << " is damaged; skipping the unreadable file.\n";
+            }
+            if (!ve.hasProfile) {
+                continue;
+            }
+            addCustomer(Customer(ve.username, ve.password, ve.accountHash));
+            if (ve.hasAccount) {
+                insertAccount(Account(ve.name, ve.number, ve.balance));
+                if (ve.number >= nextAccountNumber) {
+                    nextAccountNumber = ve.number + 1;
+                }
+            }
+        }
+        // Load employees from vaults/employees/[username]/profile.json and account.json (if needed)
+        // Employee accounts are always read, since they record which employee owns each account
+        dirs = employeeDirs;
+        readVaultEntries(dirs, true, entries);
+        for (size_t i = 0; i < entries.size(); i++) {
+            const VaultEntry& ve = entries[i];
+            if (ve.damaged) {
+                cout << "Vault " << dirs[i].string() << " is damaged; skipping the unreadable file.\n";
+            }
+            if (!ve.hasProfile) {
+                continue;
+            }
+            addEmployee(Employee(ve.username, ve.password));
+            if (ve.hasAccount) {
+                accountOwners[ve.number] = {true, employees.size() - 1};
+                if (loadAccounts) {
+                    insertAccount(Account(ve.name, ve.number, ve.balance));
+                    if (ve.number >= nextAccountNumber) {
+                        nextAccountNumber = ve.number + 1;
+                    }
+                }
+            }
+        }
+        // Hash every loaded account number in one batch for customer lookups
+        if (loadAccounts) {
+            indexAccountHashes(0);
+        }
+        finishLoad();
+        if (!planned) {
+            rebuildManifest();
+        }
+    }
+    // Adopts the fan-out layout recorded in vaults/customers. A vault with no customers yet takes
+    // the requested fan-out, or keeps the recorded one if none was requested (-1); an existing one
+    // must already use it. Returns false on a mismatch, which needs migrateCustomerVaults.
+    bool openCustomerLayout(int requested) {
+        nlohmann::json layout;
+        int onDisk = readVaultFile(customerLayoutFile, layout) ? layout.value("fanout", 0) : 0;
+        if (!listVaultDirs("vaults/customers").empty()) {
+            customerFanout = onDisk;
+            if (requested >= 0 && requested != onDisk) {
+                cout << "vaults/customers uses fan-out " << onDisk << "; run with --migrate-vaults "
+                     << requested << " to change it.\n";
+                return false;
+            }
+            return true;
+        }
+        customerFanout = requested >= 0 ? requested : onDisk;
+        if (customerFanout != onDisk) {
+            writeCustomerLayout();
+        }
+        return true;
+    }
+    // Moves every customer vault into the given fan-out layout and records it. Finds vaults at any
+    // depth, so a migration that was interrupted can simply be run again. Run with no bank loaded.
+    bool migrateCustomerVaults(int fanout) {
+        vector<fs::path> found;
+        if (fs::exists("vaults/customers")) {
+            for (auto it = fs::recursive_directory_iterator("vaults/customers"); it != fs::recursive_directory_iterator(); ++it) {
+                if (it->is_directory() && fs::exists(it->path() / "profile.json")) {
+                    found.push_back(it->path());
+                    it.disable_recursion_pending();
+                }
+            }
+        }
+        // Vaults are first moved aside into a staging directory, so a username that looks like a
+        // bucket (e.g. "ab") can never end up holding another customer's vault mid-migration
+        fs::path staging = "vaults/customers/.migrate";
+        fs::create_directories(staging);
+        vector<fs::path> staged;
+        for (const auto& dir : found) {
+            if (dir == fs::path(customerVaultDir(dir.filename().string(), fanout))) {
+                continue;
+            }
+            fs::path aside = staging / dir.filename();
+            if (dir != aside) {
+                fs::rename(dir, aside);
+            }
+            staged.push_back(aside);
+        }
+        for (const auto& dir : staged) {
+            fs::path target = customerVaultDir(dir.filename().string(), fanout);
+            if (fs::exists(target)) {
+                cout << "Cannot move " << dir.string() << ": " << target.string() << " already exists.\n";
+                return false;
+            }
+            fs::create_directories(target.parent_path());
+            fs::rename(dir, target);
+        }
+        size_t moved = staged.size();
+        // Remove the bucket directories the old layout leaves empty, deepest first
+        vector<fs::path> buckets;
+        for (const auto& entry : fs::recursive_directory_iterator("vaults/customers")) {
+            if (entry.is_directory()) {
+                buckets.push_back(entry.path());
+            }
+        }
+        sort(buckets.rbegin(), buckets.rend());
+        for (const auto& bucket : buckets) {
+            if (fs::is_empty(bucket)) {
+                fs::remove(bucket);
+            }
+        }
+        customerFanout = fanout;
+        if (!writeCustomerLayout()) {
+            return false;
+        }
+        cout << "Moved " << moved << " of " << found.size() << " customer vaults to fan-out " << fanout << ".\n";
+        return true;
+    }
+    // Sets the encoding for vault files written from now on; existing files are read as they are.
+    void setVaultFormat(VaultFormat format) {
+        vaultFormat = format;
+    }
+    // Sets how many threads loadUsersFromFile parses vault directories with.
+    void setLoadThreads(unsigned threads) {
+        loadThreads = max(1u, threads);
+    }
+    // Saves new or changed customers, employees and accounts to their directories (no encryption).
+    // Returns false if any file could not be written; the changes stay pending for the next save
+    // and lastSaveError says why.
+    bool saveUsersToFile(const string& customerFile, const string& employeeFile) {
+        // New users are listed in the manifest once their files are written, so a failed save that
+        // is retried never lists them twice
+        vector<VaultManifest::Entry> added;
+        for (size_t i : dirtyCustomers) {
+            int number = accountNumberByHash(customers[i].getAccountHash());
+            added.push_back({false, number, customers[i].getUsername()});
+            if (lazyVaults && number != 0) {
+                customerByAccount[number] = customers[i].getUsername();
+            }
+        }
+        for (size_t i : dirtyEmployees) {
+            added.push_back({true, 0, employees[i].getUsername()});
+        }
+        // Every file goes through one batch; accounts are written before the profiles so a
+        // crash mid-pass never leaves a new customer without an account.json
+        VaultWriteBatch batch("vaults");
+        // Save each changed account.json into its owner's directory
+        for (int number : dirtyAccounts) {
+            auto owner = accountOwners.find(number);
+            const Account* acc = accountByNumber(number);
+            if (owner == accountOwners.end() || acc == nullptr) {
+                continue;
+            }
+            string ownerDir = owner->second.isEmployee
+                ? "vaults/employees/" + employees[owner->second.index].getUsername()
+                : customerVaultDir(customers[owner->second.index].getUsername());
+            writeAccountFile(batch, *acc, ownerDir);
+        }
+        // Save customer profiles
+        for (size_t i : dirtyCustomers) {
+            const Customer& c = customers[i];
+            string custDir = customerVaultDir(c.getUsername());
+            nlohmann::json cj = {
+                {"username", c.getUsername()},
+                {"password", c.getPassword().toHex()},
+                {"accountNumber", c.getAccountHash().toHex()}
+            };
+            batch.write(custDir + "/profile.json", cj, vaultFormat);
+        }
+        // Save employee profiles
+        for (size_t i : dirtyEmployees) {
+            const Employee& e = employees[i];
+            string empDir = "vaults/employees/" + e.getUsername();
+            nlohmann::json ej = {
+                {"username", e.getUsername()},
+                {"password", e.getPassword().toHex()}
+            };
+            batch.write(empDir + "/profile.json", ej, vaultFormat);
+        }
+        bool saved = batch.commit();
+        saveError = batch.error();
+        // Filesystem errors leave the changes pending instead of throwing out of a server thread
+        error_code ec;
+        bool newUsers = !dirtyCustomers.empty() || !dirtyEmployees.empty();
+        // The snapshot does not contain the users just written, so stop trusting it
+        if (!snapshotFile.empty() && newUsers) {
+            fs::remove(snapshotFile, ec);
+            if (ec) {
+                saveError = "Unable to remove stale snapshot " + snapshotFile + ": " + ec.message();
+                saved = false;
+            } else {
+                snapshotFile.clear();
+            }
+        }
+        // Nor does an account table this run is not using
+        if (!accountTable.isOpen() && newUsers) {
+            fs::remove(accountTableFile, ec);
+            if (ec) {
+                saveError = "Unable to remove stale account table " + accountTableFile + ": " + ec.message();
+                saved = false;
+            }
+        }
+        if (!saved) {
+            return false;
+        }
+        // Without a complete manifest to extend, retire it; the next load rescans the vaults
+        if (!added.empty() && (!manifest.isOpen() || !manifest.append(added))) {
+            manifest.close();
+            fs::remove(manifestFile, ec);
+            if (ec) {
+                saveError = "Unable to update manifest " + manifestFile + ": " + ec.message();
+                return false;
+            }
+        }
+        dirtyCustomers.clear();
+        dirtyEmployees.clear();
+        dirtyAccounts.clear();
+        return true;
+    }
+};
+
+// Allows an employee to view all accounts in the bank.
+inline void Employee::viewAllAccounts(Bank& bank) const {
+    bank.showAllAccounts();
+}
+
+// ==========================
+//   Binary request protocol
+// ==========================
+// A cheaper alternative to the text commands for automated clients. A connection whose first byte
+// is BINARY_PROTOCOL_MAGIC uses it from then on. Every request after that byte is
+//   u32 length | u32 request id | u8 operation | operands
+// and every response is
+//   u32 length | u32 request id | u8 status | result (only when the status is Ok)
+// where length counts the bytes after itself. Values use the ByteWriter encoding: native byte
+// order, amounts as i64 cents, strings prefixed with a u32 length. A connection runs its requests
+// in order, so a client may send many before reading any response and match them up by id.
+const unsigned char BINARY_PROTOCOL_MAGIC = 0xB1;
+// Requests longer than this, or too short to hold a request id and operation, are rejected by
+// closing the connection.
+const uint32_t MAX_REQUEST_SIZE = 64 * 1024;
+const uint32_t MIN_REQUEST_SIZE = sizeof(uint32_t) + sizeof(uint8_t);
+
+// Operations, with their operands and Ok result.
+enum class WireOp : uint8_t {
+    Auth = 1,       // u8 role (0 customer, 1 employee), username, password -> i32 account (-1 for employees)
+    Deposit = 2,    // i64 amount -> i64 balance
+    Withdraw = 3,   // i64 amount -> i64 balance
+    Transfer = 4,   // i64 amount, i32 recipient account -> i64 balance
+    Balance = 5,    // none -> i64 balance
+    List = 6        // none (employees only) -> u32 count, then i32 account, owner, i64 balance each
+};
+
+// Response status codes.
+enum class WireStatus : uint8_t {
+    Ok = 0,
+    InvalidAmount = 1,
+    InsufficientFunds = 2,
+    Overflow = 3,
+    NotAuthenticated = 4,
+    InvalidLogin = 5,
+    NoSuchAccount = 6,
+    BadRequest = 7,
+    Forbidden = 8,
+    NotDurable = 9    // applied, but not yet in the transaction log; it is retried on the next commit
+};
+
+// Maps the outcome of an account operation to its response status.
+WireStatus wireStatus(AccountResult result) {
+    switch (result) {
+    case AccountResult::Ok: return WireStatus::Ok;
+    case AccountResult::InsufficientFunds: return WireStatus::InsufficientFunds;
+    case AccountResult::Overflow: return WireStatus::Overflow;
+    default: return WireStatus::InvalidAmount;
+    }
+}
+
+// --------------------------
+// CommandSession Class
+// --------------------------
+// A CommandSession runs line-oriented commands against the bank for one client, without prompts:
+//   register <username> <password> <deposit> <full name>
+//   login <username> <password>
+//   logout
+//   deposit <amount>
+//   withdraw <amount>
+//   transfer <amount> <account>
+//   show
+// Blank lines and lines starting with # are skipped. Each command writes one result line.
+// The same session also runs binary protocol requests (see executeRequest).
+class CommandSession {
+private:
+    Bank& bank;
+    ostream& out;
+    // Logged-in customer and their account number (empty / -1 when logged out).
+    string username;
+    int accountNumber = -1;
+    // Set while an employee is logged in (binary protocol only).
+    bool employee = false;
+    // Registrations are saved to the vaults after this many, and always on flush().
+    size_t saveInterval = 1;
+    size_t unsavedRegistrations = 0;
+
+    // Parses an amount argument, reporting a bad one.
+    bool readAmount(istringstream& args, Money& amount) {
+        string text;
+        if (!(args >> text) || !Money::parse(text, amount)) {
+            out << "ERR invalid amount\n";
+            return false;
+        }
+        return true;
+    }
+    // Returns the logged-in customer's account, looked up afresh since lazy loads can move it.
+    Account* currentAccount() {
+        if (accountNumber < 0) {
+            out << "ERR not logged in\n";
+            return nullptr;
+        }
+        return bank.findAccount(accountNumber);
+    }
+    // Logs in as a customer after ending any earlier login. Returns false if the login is invalid.
+    bool loginAs(const string& name, const string& password) {
+        logout();
+        const Customer* cust = bank.loginCustomer(name, password);
+        const Account* acc = cust != nullptr ? bank.findAccountByHash(cust->getAccountHash()) : nullptr;
+        if (acc == nullptr) {
+            return false;
+        }
+        username = name;
+        accountNumber = acc->getAccountNumber();
+        bank.pinCustomer(username);
+        return true;
+    }
+    // Runs one binary request and writes its result; the caller frames the response.
+    WireStatus runRequest(WireOp op, ByteReader& in, ByteWriter& result) {
+        if (op == WireOp::Auth) {
+            uint8_t role = in.get<uint8_t>();
+            string name = in.getString();
+            string password = in.getString();
+            if (!in.ok() || role > 1) {
+                return WireStatus::BadRequest;
+            }
+            if (role == 1) {
+                logout();
+                if (bank.loginEmployee(name, password) == nullptr) {
+                    return WireStatus::InvalidLogin;
+                }
+                employee = true;
+                result.put<int32_t>(-1);
+            } else {
+                if (!loginAs(name, password)) {
+                    return WireStatus::InvalidLogin;
+                }
+                result.put<int32_t>(accountNumber);
+            }
+            return WireStatus::Ok;
+        }
+        if (op == WireOp::List) {
+            if (!employee) {
+                return accountNumber < 0 ? WireStatus::NotAuthenticated : WireStatus::Forbidden;
+            }
+            size_t countAt = result.bytes.size();
+            uint32_t count = 0;
+            result.put<uint32_t>(0);
+            bank.visitAllAccounts([&](const Account& acc) {
+                result.put<int32_t>(acc.getAccountNumber());
+                result.putString(acc.getOwnerName());
+                result.put<int64_t>(acc.getBalance().getCents());
+                count++;
+            });
+            memcpy(&result.bytes[countAt], &count, sizeof(count));
+            return WireStatus::Ok;
+        }
+        if (op != WireOp::Deposit && op != WireOp::Withdraw && op != WireOp::Transfer && op != WireOp::Balance) {
+            return WireStatus::BadRequest;
+        }
+        Money amount(op == WireOp::Balance ? 0 : in.get<int64_t>());
+        int32_t recipientNumber = op == WireOp::Transfer ? in.get<int32_t>() : 0;
+        if (!in.ok()) {
+            return WireStatus::BadRequest;
+        }
+        if (accountNumber < 0) {
+            return WireStatus::NotAuthenticated;
+        }
+        Account* acc = bank.findAccount(accountNumber);
+        AccountResult outcome = AccountResult::Ok;
+        bool recorded = true;
+        if (op == WireOp::Deposit) {
+            outcome = acc->deposit(amount);
+            if (outcome == AccountResult::Ok) {
+                recorded = bank.recordTransaction(*acc);
+            }
+        } else if (op == WireOp::Withdraw) {
+            outcome = acc->withdraw(amount);
+            if (outcome == AccountResult::Ok) {
+                recorded = bank.recordTransaction(*acc);
+            }
+        } else if (op == WireOp::Transfer) {
+            Account* recipient = bank.findAccount(recipientNumber);
+            if (recipient == nullptr) {
+                return WireStatus::NoSuchAccount;
+            }
+            // Loading the recipient may have moved this customer's account
+            acc = bank.findAccount(accountNumber);
+            outcome = acc->transferTo(*recipient, amount);
+            if (outcome == AccountResult::Ok) {
+                recorded = bank.recordTransaction(*acc, recipient);
+            }
+        }
+        if (outcome != AccountResult::Ok) {
+            return wireStatus(outcome);
+        }
+        if (!recorded) {
+            return WireStatus::NotDurable;
+        }
+        result.put<int64_t>(acc->getBalance().getCents());
+        return WireStatus::Ok;
+    }
+
+public:
+    CommandSession(Bank& bank, ostream& out) : bank(bank), out(out) {}
+    CommandSession(const CommandSession&) = delete;
+    CommandSession& operator=(const CommandSession&) = delete;
+    ~CommandSession() {
+        logout();
+        flush();
+    }
+
+    // Sets how many registrations may be pending before they are saved (1 = save each one).
+    void setSaveInterval(size_t registrations) {
+        saveInterval = registrations == 0 ? 1 : registrations;
+    }
+
+    // Saves pending registrations and makes every recorded transaction durable. Returns false if
+    // the registrations could not be saved; they stay pending for the next flush.
+    bool flush() {
+        bool saved = unsavedRegistrations == 0 || bank.saveUsersToFile("vaults/customers.json", "vaults/employees.json");
+        if (saved) {
+            unsavedRegistrations = 0;
+        }
+        bank.commitTransactions();
+        return saved;
+    }
+
+    // Ends the current login, if any.
+    void logout() {
+        if (accountNumber >= 0) {
+            bank.unpinCustomer(username);
+        }
+        username.clear();
+        accountNumber = -1;
+        employee = false;
+    }
+
+    // Runs one binary request (the bytes after its length prefix) and appends the framed
+    // response to reply.
+    void executeRequest(const char* request, size_t length, ByteWriter& reply) {
+        ByteReader in(request, length);
+        uint32_t requestId = in.get<uint32_t>();
+        WireOp op = (WireOp)in.get<uint8_t>();
+        size_t frameStart = reply.bytes.size();
+        reply.put<uint32_t>(0);
+        reply.put<uint32_t>(requestId);
+        reply.put<uint8_t>(0);
+        size_t headerEnd = reply.bytes.size();
+        WireStatus status = in.ok() ? runRequest(op, in, reply) : WireStatus::BadRequest;
+        // Only a successful request carries a result
+        if (status != WireStatus::Ok) {
+            reply.bytes.resize(headerEnd);
+        }
+        reply.bytes[headerEnd - 1] = (char)status;
+        uint32_t frameLength = (uint32_t)(reply.bytes.size() - frameStart - sizeof(uint32_t));
+        memcpy(&reply.bytes[frameStart], &frameLength, sizeof(frameLength));
+    }
+
+    // Runs one command line and writes its result.
+    void execute(const string& line) {
+        istringstream args(line);
+        string command;
+        if (!(args >> command) || command[0] == '#') {
+            return;
+        }
+        if (command == "register") {
+            string newUsername, newPassword, name;
+            Money deposit;
+            if (!(args >> newUsername >> newPassword)) {
+                out << "ERR usage: register <username> <password> <deposit> <full name>\n";
+                return;
+            }
+            if (!readAmount(args, deposit)) {
+                return;
+            }
+            if (deposit < Money()) {
+                out << "ERR invalid amount\n";
+                return;
+            }
+            if (!Bank::isValidUsername(newUsername)) {
+                out << "ERR invalid username\n";
+                return;
+            }
+            if (bank.hasCustomer(newUsername)) {
+                out << "ERR username taken\n";
+                return;
+            }
+            getline(args >> ws, name);
+            int number = bank.addAccount(name, deposit);
+            if (number < 0) {
+                out << "ERR account not created\n";
+                return;
+            }
+            bank.addCustomer(Customer(newUsername, newPassword, sha256_digest(to_string(number))));
+            if (++unsavedRegistrations >= saveInterval && !flush()) {
+                out << "ERR registration not saved (" << bank.lastSaveError() << "); it will be retried\n";
+                return;
+            }
+            out << "OK registered " << newUsername << " account " << number << '\n';
+        } else if (command == "login") {
+            string loginName, password;
+            args >> loginName >> password;
+            if (!loginAs(loginName, password)) {
+                out << "ERR invalid login\n";
+                return;
+            }
+            out << "OK logged in " << username << " account " << accountNumber << '\n';
+        } else if (command == "logout") {
+            logout();
+            out << "OK logged out\n";
+        } else if (command == "deposit" || command == "withdraw") {
+            Money amount;
+            Account* acc = currentAccount();
+            if (acc == nullptr || !readAmount(args, amount)) {
+                return;
+            }
+            AccountResult result = command == "deposit" ? acc->deposit(amount) : acc->withdraw(amount);
+            if (result == AccountResult::Ok && !bank.recordTransaction(*acc)) {
+                out << NOT_DURABLE_PREFIX;
+            }
+            if (command == "deposit") {
+                reportDeposit(out, result, amount, accountNumber);
+            } else {
+                reportWithdrawal(out, result, amount, accountNumber);
+            }
+        } else if (command == "transfer") {
+            Money amount;
+            int recipientNumber;
+            if (currentAccount() == nullptr || !readAmount(args, amount)) {
+                return;
+            }
+            if (!(args >> recipientNumber)) {
+                out << "ERR usage: transfer <amount> <account>\n";
+                return;
+            }
+            Account* recipient = bank.findAccount(recipientNumber);
+            if (recipient == nullptr) {
+                out << "Transfer failed: recipient account not found.\n";
+                return;
+            }
+            // Loading the recipient may have moved this customer's account
+            Account* acc = bank.findAccount(accountNumber);
+            AccountResult result = acc->transferTo(*recipient, amount);
+            if (result == AccountResult::Ok && !bank.recordTransaction(*acc, recipient)) {
+                out << NOT_DURABLE_PREFIX;
+            }
+            reportTransfer(out, result, amount, accountNumber, recipientNumber);
+        } else if (command == "show") {
+            Account* acc = currentAccount();
+            if (acc != nullptr) {
+                acc->display(out);
+            }
+        } else {
+            out << "ERR unknown command " << command << '\n';
+        }
+    }
+};
+
+// ==========================================================
+//                        SELF TEST
+// ==========================================================
+// Known-answer tests from FIPS 180-2 (message, expected digest in hex).
+static const char* const SHA256_TEST_VECTORS[][2] = {
+    {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+     "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+};
+// Digest of one million 'a' characters.
+static const char* const SHA256_MILLION_A = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+
+// Hashes message with the current block transform, feeding it to sha256_update in chunk-sized
+// pieces (0 = all at once).
+static void selfTestHash(const string& message, size_t chunk, BYTE hash[]) {
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    size_t step = chunk == 0 ? max<size_t>(message.size(), 1) : chunk;
+    for (size_t i = 0; i < message.size(); i += step) {
+        sha256_update(&ctx, (const BYTE*)message.data() + i, min(step, message.size() - i));
+    }
+    sha256_final(&ctx, hash);
+}
+
+// Checks one block transform against the known answers, whole and in odd-sized chunks.
+// Returns the number of failures.
+static int selfTestTransform(const char* name, SHA256_TRANSFORM transform) {
+    SHA256_TRANSFORM previous = sha256_block;
+    sha256_block = transform;
+    vector<pair<string, string>> cases;
+    for (const auto& vector : SHA256_TEST_VECTORS) {
+        cases.emplace_back(vector[0], vector[1]);
+    }
+    cases.emplace_back(string(1000000, 'a'), SHA256_MILLION_A);
+    int failures = 0;
+    for (const auto& test : cases) {
+        BYTE expected[SHA256_BLOCK_SIZE];
+        if (test.second.size() != SHA256_BLOCK_SIZE * 2 || !hex_decode(test.second.c_str(), SHA256_BLOCK_SIZE, expected)) {
+            cout << "FAIL " << name << ": bad expected digest for the " << test.first.size() << "-byte vector\n";
+            failures++;
+            continue;
+        }
+        for (size_t chunk : {0, 1, 63, 64, 65}) {
+            BYTE hash[SHA256_BLOCK_SIZE];
+            selfTestHash(test.first, chunk, hash);
+            if (memcmp(hash, expected, SHA256_BLOCK_SIZE) != 0) {
+                cout << "FAIL " << name << ": " << test.first.size() << "-byte vector, chunk " << chunk << '\n';
+                failures++;
+            }
+        }
+    }
+    sha256_block = previous;
+    cout << (failures == 0 ? "PASS " : "FAIL ") << name << " transform\n";
+    return failures;
+}
+
+// Checks a batch kernel against the single-buffer digests of the known answers plus batches of
+// random messages of every length up to a few blocks. Returns the number of failures.
+static int selfTestMany(const char* name, SHA256_MANY many) {
+    vector<string> messages;
+    for (const auto& vector : SHA256_TEST_VECTORS) {
+        messages.push_back(vector[0]);
+    }
+    mt19937 rng(2024);
+    for (int i = 0; i < 3000; i++) {
+        string message(rng() % 300, '\0');
+        for (char& c : message) {
+            c = (char)rng();
+        }
+        messages.push_back(message);
+    }
+    int failures = 0;
+    // Batch sizes that are not multiples of the lane count exercise the partial last group
+    for (size_t batch : {1, 7, 8, 9, 1000}) {
+        for (size_t first = 0; first < messages.size(); first += batch) {
+            size_t count = min(batch, messages.size() - first);
+            vector<const BYTE*> data(count);
+            vector<size_t> lens(count);
+            for (size_t i = 0; i < count; i++) {
+                data[i] = (const BYTE*)messages[first + i].data();
+                lens[i] = messages[first + i].size();
+            }
+            vector<Digest> hashes(count);
+            many(data.data(), lens.data(), count, (BYTE(*)[SHA256_BLOCK_SIZE])hashes.data());
+            for (size_t i = 0; i < count; i++) {
+                if (hashes[i] != sha256_digest(messages[first + i])) {
+                    cout << "FAIL " << name << ": " << lens[i] << "-byte message, batch of " << batch << '\n';
+                    failures++;
+                }
+            }
+        }
+    }
+    cout << (failures == 0 ? "PASS " : "FAIL ") << name << " batch kernel\n";
+    return failures;
+}
+
+// Returns user's balance after logging in with password, or "none" if the login or account is missing.
+static string selfTestBalance(Bank& bank, const string& user, const string& password) {
+    const Customer* cust = bank.loginCustomer(user, password);
+    const Account* acc = cust != nullptr ? bank.findAccountByHash(cust->getAccountHash()) : nullptr;
+    return acc != nullptr ? acc->getBalance().toString() : "none";
+}
+
+// Leaves the vault in the current directory as a save would if it crashed after `renames` of its
+// three renames. The save raises alice's balance to $150.00 and registers bob with $5.00.
+static void selfTestCrashedSave(int renames) {
+    const string files[] = {"vaults/customers/alice/account.json", "vaults/customers/bob/account.json",
+                            "vaults/customers/bob/profile.json"};
+    fs::create_directories("vaults/customers/bob");
+    VaultWriteBatch batch("vaults");
+    batch.write(files[0], {{"name", "Alice"}, {"number", 1000}, {"balanceCents", 15000}}, VaultFormat::Compact);
+    batch.write(files[1], {{"name", "Bob"}, {"number", 1001}, {"balanceCents", 500}}, VaultFormat::Compact);
+    batch.write(files[2], {{"username", "bob"}, {"password", sha256_digest("pw2").toHex()},
+                           {"accountNumber", sha256_digest("1001").toHex()}}, VaultFormat::Compact);
+    for (int i = 0; i < renames; i++) {
+        ::rename((files[i] + ".tmp").c_str(), files[i].c_str());
+    }
+    // The batch is dropped without commit(), as a crash would leave it
+}
+
+// Injects crashes into a vault save and checks that loading afterwards sees every file either
+// whole before or whole after the save, and survives a torn file. Runs in a scratch directory.
+// Returns the number of failures.
+static int selfTestVaultCrashes() {
+    char scratch[] = "/tmp/bankSim-selftest-XXXXXX";
+    if (::mkdtemp(scratch) == nullptr) {
+        cout << "FAIL vault crash recovery: no scratch directory\n";
+        return 1;
+    }
+    fs::path home = fs::current_path();
+    int failures = 0;
+    for (int renames = 0; renames <= 4; renames++) {
+        // renames == 4 is a finished save whose account.json was then torn
+        fs::path dir = fs::path(scratch) / to_string(renames);
+        fs::create_directories(dir);
+        fs::current_path(dir);
+        {
+            Bank bank;
+            int number = bank.addAccount("Alice", Money(10000));
+            bank.addCustomer(Customer("alice", "pw", sha256_digest(to_string(number))));
+            bank.saveUsersToFile("vaults/customers.json", "vaults/employees.json");
+        }
+        selfTestCrashedSave(min(renames, 3));
+        if (renames == 4) {
+            fs::resize_file("vaults/customers/alice/account.json", 10);
+        }
+        // The save never got to list bob, so rebuild the manifest by scanning
+        fs::remove("vaults/manifest.bin");
+        Bank bank;
+        bank.loadUsersFromFile("vaults/customers.json", "vaults/employees.json");
+        string alice = selfTestBalance(bank, "alice", "pw");
+        string bob = selfTestBalance(bank, "bob", "pw2");
+        string wantAlice = renames == 0 ? "100.00" : renames == 4 ? "none" : "150.00";
+        string wantBob = renames >= 3 ? "5.00" : "none";
+        if (alice != wantAlice || bob != wantBob) {
+            cout << "FAIL vault crash recovery after " << renames << " renames: alice " << alice
+                 << ", bob " << bob << " (expected " << wantAlice << ", " << wantBob << ")\n";
+            failures++;
+        }
+        fs::current_path(home);
+    }
+    fs::remove_all(scratch);
+    cout << (failures == 0 ? "PASS " : "FAIL ") << "vault crash recovery\n";
+    return failures;
+}
+
+// Runs the SHA-256 known-answer tests on every kernel this CPU supports, so that the scalar,
+// SHA-NI and AVX2 code paths are held to the same digests, then the vault crash-recovery check.
+// Returns true if all of them pass.
+bool runSelfTest() {
+    int failures = selfTestTransform("scalar", sha256_transform);
+#ifdef SHA256_X86
+    if (cpu_has_shani()) {
+        failures += selfTestTransform("SHA-NI", sha256_transform_shani);
+    } else {
+        cout << "SKIP SHA-NI transform (not supported by this CPU)\n";
+    }
+#endif
+    // The batch kernels are compared with sha256_digest, so check them after the transforms
+    failures += selfTestMany("scalar", sha256_many_scalar);
+#ifdef SHA256_X86
+    if (cpu_has_avx2()) {
+        failures += selfTestMany("AVX2", sha256_many_avx2);
+    } else {
+        cout << "SKIP AVX2 batch kernel (not supported by this CPU)\n";
+    }
+#endif
+    failures += selfTestVaultCrashes();
+    cout << (failures == 0 ? "All self tests passed.\n" : "Self test FAILED.\n");
+    return failures == 0;
+}
+
+// Checkpoints the bank before exiting and says what, if anything, did not reach the vaults.
+void checkpointOnExit(Bank& bank) {
+    if (!bank.checkpoint("vaults/bank.snap", "vaults/customers.json", "vaults/employees.json")) {
+        cout << "Not every change was saved to the vaults (" << bank.lastSaveError()
+             << "); the transaction log has been kept.\n";
+    }
+}
+
+// ==========================================================
+//                        BATCH MODE
+// ==========================================================
+// Runs every command in source ("-" for stdin) through one CommandSession, then reports the
+// throughput on stderr. groupSize is how many transactions and registrations share one fsync.
+// Returns false if the source cannot be opened.
+bool runBatch(Bank& bank, const string& source, size_t groupSize) {
+    ifstream file;
+    if (source != "-") {
+        file.open(source);
+        if (!file.is_open()) {
+            cout << "Unable to open batch file " << source << '\n';
+            return false;
+        }
+    }
+    istream& in = source == "-" ? cin : file;
+    // No prompts to show, so results are written out only as the buffer fills
+    cin.tie(nullptr);
+    bank.setTransactionGroupSize(groupSize);
+    size_t commands = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        CommandSession session(bank, cout);
+        session.setSaveInterval(groupSize);
+        string line;
+        while (getline(in, line)) {
+            session.execute(line);
+            commands++;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout.flush();
+    cerr << commands << " commands in " << fixed << setprecision(3) << seconds << " s ("
+         << (long long)(seconds > 0 ? commands / seconds : 0) << " commands/s)\n";
+    return true;
+}
+
+// ==========================================================
+//                        SERVER MODE
+// ==========================================================
+#ifdef __linux__
+// eventfd that wakes every server thread for shutdown; written by the SIGINT/SIGTERM handler.
+static int serverStopFd = -1;
+
+// Signal handler: asks the server to shut down cleanly.
+static void stopServer(int) {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(serverStopFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Raises the open-file limit to its hard maximum so thousands of sockets fit.
+static void raiseFileLimit() {
+    rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Fills addr with the Unix socket address for path. Returns false if the path is too long.
+static bool unixSocketAddress(const string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        cout << "Socket path " << path << " is too long\n";
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// --------------------------
+// BankServer Class
+// --------------------------
+// The BankServer runs one CommandSession per client on a Unix socket. A client speaks either the
+// batch-mode text commands or, if its first byte is BINARY_PROTOCOL_MAGIC, the binary protocol.
+// The listening socket and every client share one epoll instance, each armed one-shot,
+// so a small pool of threads waits on it together while only one thread at a time handles any
+// given socket. Commands run under bankMutex; results are written back without blocking.
+class BankServer {
+private:
+    // A connected client: its socket, unparsed input, unsent output and session.
+    struct Connection {
+        int fd;
+        string input;
+        string output;
+        size_t outputSent = 0;
+        // Set once the client has finished sending
+        bool inputClosed = false;
+        // Set once the first byte has picked the protocol
+        bool protocolKnown = false;
+        bool binary = false;
+        // Results of text commands and binary requests, before they join output
+        ostringstream results;
+        ByteWriter replies;
+        CommandSession session;
+        Connection(int socket, Bank& bank) : fd(socket), session(bank, results) {}
+        // Bytes of output not yet sent.
+        size_t backlog() { return output.size() - outputSent + (size_t)results.tellp() + replies.bytes.size(); }
+    };
+    // epoll tags for the two sockets that are not connections.
+    static const uint64_t LISTEN_TAG = 1;
+    static const uint64_t STOP_TAG = 2;
+    // A text line longer than this closes the connection; past this much unsent output, input waits.
+    static const size_t MAX_LINE = 64 * 1024;
+    static const size_t MAX_BACKLOG = 1024 * 1024;
+
+    Bank& bank;
+    mutex bankMutex;
+    size_t saveInterval;
+    int listenFd = -1;
+    int epollFd = -1;
+    mutex connectionsMutex;
+    unordered_map<Connection*, unique_ptr<Connection>> connections;
+
+    // (Re)arms fd in the epoll set for the given events, one-shot.
+    void arm(int fd, uint64_t tag, uint32_t events, int op = EPOLL_CTL_MOD) {
+        epoll_event ev;
+        ev.events = events | EPOLLONESHOT;
+        ev.data.u64 = tag;
+        ::epoll_ctl(epollFd, op, fd, &ev);
+    }
+
+    // Accepts every pending client.
+    void acceptClients() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    cout << "Unable to accept a client: " << strerror(errno) << '\n';
+                }
+                if (errno != EINTR) {
+                    break;
+                }
+                continue;
+            }
+            unique_ptr<Connection> conn(new Connection(fd, bank));
+            conn->session.setSaveInterval(saveInterval);
+            Connection* raw = conn.get();
+            {
+                lock_guard<mutex> lock(connectionsMutex);
+                connections[raw] = move(conn);
+            }
+            arm(fd, (uint64_t)(uintptr_t)raw, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+        arm(listenFd, LISTEN_TAG, EPOLLIN);
+    }
 
-    stringstream ss;
-    for (int i = 0; i < SHA256_BLOCK_SIZE; i++) {
-        ss << hex << setw(2) << setfill('0') << (int)hash[i];
+    // Reads what the client has sent. Returns false if the connection failed.
+    bool readInput(Connection& conn) {
+        char buffer[16384];
+        while (!conn.inputClosed && conn.input.size() < MAX_BACKLOG) {
+            ssize_t n = ::read(conn.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                conn.input.append(buffer, n);
+            } else if (n == 0) {
+                conn.inputClosed = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
     }
-    return ss.str();
-}
 
-// ==========================
-//        Class Definitions
-// ==========================
+    // Runs the complete text lines received so far, until the output backlog is full.
+    // Returns false if the client sent an overlong line.
+    bool runLines(Connection& conn) {
+        size_t start = 0;
+        size_t end = conn.input.find('\n');
+        // A final line without a newline still counts once the client is done sending
+        if (end == string::npos && conn.inputClosed && !conn.input.empty()) {
+            end = conn.input.size();
+        }
+        if (end == string::npos) {
+            return conn.input.size() < MAX_LINE;
+        }
+        {
+            lock_guard<mutex> lock(bankMutex);
+            while (end != string::npos && conn.backlog() < MAX_BACKLOG) {
+                size_t length = end - start;
+                if (length > 0 && conn.input[end - 1] == '\r') {
+                    length--;
+                }
+                conn.session.execute(conn.input.substr(start, length));
+                start = min(end + 1, conn.input.size());
+                end = conn.input.find('\n', start);
+                if (end == string::npos && conn.inputClosed && start < conn.input.size()) {
+                    end = conn.input.size();
+                }
+            }
+        }
+        conn.input.erase(0, start);
+        if (conn.results.tellp() > 0) {
+            conn.output += conn.results.str();
+            conn.results.str("");
+        }
+        return true;
+    }
 
-// --------------------------
-// Account Class
-// --------------------------
-// The Account class represents a bank account with basic operations like deposit, withdraw, and transfer.
-class Account {
-private:
-    string ownerName;
-    int accountNumber;
-    double balance;
-public:
-    // Constructs an Account with the owner's name, account number, and initial deposit.
-    Account(string name, int accNumber, double initialDeposit) {
-        ownerName = name;
-        accountNumber = accNumber;
-        balance = initialDeposit;
+    // Returns the length of the binary request at the front of input, or 0 if it has not fully
+    // arrived. Sets malformed if its length prefix is outside MIN_REQUEST_SIZE..MAX_REQUEST_SIZE.
+    static uint32_t completeRequest(const string& input, size_t start, bool& malformed) {
+        uint32_t length;
+        if (input.size() - start < sizeof(length)) {
+            return 0;
+        }
+        memcpy(&length, input.data() + start, sizeof(length));
+        malformed = length < MIN_REQUEST_SIZE || length > MAX_REQUEST_SIZE;
+        return !malformed && input.size() - start - sizeof(length) >= length ? length : 0;
     }
 
-    // Deposits a positive amount into the account.
-    void deposit(double amount) {
-        if (amount > 0) {
-            balance += amount;
-            cout << "Deposited $" << amount << " to account " << accountNumber << endl;
-        } else {
-            cout << "Invalid deposit amount." << endl;
+    // Runs the complete binary requests received so far, until the output backlog is full.
+    // Returns false if the client sent a malformed request.
+    bool runRequests(Connection& conn) {
+        size_t start = 0;
+        bool malformed = false;
+        uint32_t length = completeRequest(conn.input, start, malformed);
+        if (length > 0) {
+            lock_guard<mutex> lock(bankMutex);
+            while (length > 0 && conn.backlog() < MAX_BACKLOG) {
+                conn.session.executeRequest(conn.input.data() + start + sizeof(length), length, conn.replies);
+                start += sizeof(length) + length;
+                length = completeRequest(conn.input, start, malformed);
+            }
         }
+        conn.input.erase(0, start);
+        if (!conn.replies.bytes.empty()) {
+            conn.output.append(conn.replies.bytes.data(), conn.replies.bytes.size());
+            conn.replies.bytes.clear();
+        }
+        return !malformed;
     }
 
-    // Withdraws a positive amount from the account, if sufficient funds exist.
-    void withdraw(double amount) {
-        if (amount <= 0) {
-            cout << "Invalid withdrawal amount." << endl;
-        } else if (amount > balance) {
-            cout << "Insufficient funds in account " << accountNumber << "." << endl;
-        } else {
-            balance -= amount;
-            cout << "Withdrew $" << amount << " from account " << accountNumber << endl;
+    // Runs whatever the client has sent so far in its protocol. Returns false on a protocol error.
+    bool runCommands(Connection& conn) {
+        if (!conn.protocolKnown && !conn.input.empty()) {
+            conn.protocolKnown = true;
+            conn.binary = (unsigned char)conn.input[0] == BINARY_PROTOCOL_MAGIC;
+            if (conn.binary) {
+                conn.input.erase(0, 1);
+            }
         }
+        return conn.binary ? runRequests(conn) : runLines(conn);
     }
 
-    // Transfers a positive amount to another account, if sufficient funds exist.
-    void transferTo(Account& other, double amount) {
-        if (amount <= 0) {
-            cout << "Invalid transfer amount." << endl;
-        } else if (amount > balance) {
-            cout << "Insufficient funds in account " << accountNumber << " for transfer." << endl;
-        } else {
-            balance -= amount;
-            other.balance += amount;
-            cout << "Transferred $" << amount << " from account " << accountNumber
-                 << " to account " << other.accountNumber << "." << endl;
+    // Sends as much pending output as the socket takes. Returns false if the connection failed.
+    bool writeOutput(Connection& conn) {
+        while (conn.outputSent < conn.output.size()) {
+            ssize_t n = ::send(conn.fd, conn.output.data() + conn.outputSent,
+                               conn.output.size() - conn.outputSent, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.outputSent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return false;
+            }
         }
+        conn.output.clear();
+        conn.outputSent = 0;
+        return true;
     }
 
-    // Returns the account number.
-    int getAccountNumber() const { return accountNumber; }
-    // Returns the owner's name.
-    string getOwnerName() const { return ownerName; }
-    // Returns the current balance.
-    double getBalance() const { return balance; }
-    // Displays account details.
-    void display() const {
-        cout << "Account #" << accountNumber << " | Owner: " << ownerName << " | Balance: $" << balance << endl;
+    // Drops a client: its session logs out and saves anything it left pending.
+    void closeConnection(Connection* conn) {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        unique_ptr<Connection> owned;
+        {
+            lock_guard<mutex> lock(connectionsMutex);
+            auto it = connections.find(conn);
+            owned = move(it->second);
+            connections.erase(it);
+        }
+        ::close(owned->fd);
+        lock_guard<mutex> lock(bankMutex);
+        owned.reset();
     }
-};
 
-// --------------------------
-// User Class (base)
-// --------------------------
-// The User class is a base class for customers and employees, storing username and password.
-class User {
-private:
-    string username;
-    string password;
-public:
-    // Constructs a User with a username and password (hashes the password).
-    User(string uname, string pword)
-        : username(uname), password(sha256(pword)) {}
-    // Constructs a User with a username and a password, with option to specify if password is already hashed.
-    User(string uname, string pword, bool isHashed)
-        : username(uname) {
-        password = isHashed ? pword : sha256(pword);
+    // Handles readiness on one client, then re-arms it for whatever it waits on next.
+    void serviceConnection(Connection* conn) {
+        bool healthy = readInput(*conn);
+        while (healthy) {
+            size_t pending = conn->input.size();
+            healthy = runCommands(*conn) && writeOutput(*conn);
+            // Keep going while the socket drains and commands are still waiting
+            if (conn->input.size() == pending || conn->backlog() > 0) {
+                break;
+            }
+        }
+        // Once the client is done sending, anything still unrun is an incomplete request
+        bool finished = conn->inputClosed && conn->backlog() == 0;
+        if (!healthy || finished) {
+            closeConnection(conn);
+            return;
+        }
+        uint32_t events = 0;
+        if (conn->backlog() > 0) {
+            events |= EPOLLOUT;
+        }
+        // A full input buffer waits for its commands to run rather than polling a readable socket
+        if (!conn->inputClosed && conn->backlog() < MAX_BACKLOG && conn->input.size() < MAX_BACKLOG) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        arm(conn->fd, (uint64_t)(uintptr_t)conn, events);
     }
-    // Returns the username.
-    string getUsername() const { return username; }
-    // Checks if the given password matches the user's password (hashes input before comparison).
-    bool checkPassword(const string& input) const {
-        return sha256(input) == password;
+
+    // Body of each server thread: waits on the shared epoll set until shutdown.
+    void workerLoop() {
+        epoll_event events[16];
+        while (true) {
+            int n = ::epoll_wait(epollFd, events, 16, -1);
+            if (n < 0 && errno != EINTR) {
+                return;
+            }
+            for (int i = 0; i < n; i++) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == STOP_TAG) {
+                    return;
+                } else if (tag == LISTEN_TAG) {
+                    acceptClients();
+                } else {
+                    serviceConnection((Connection*)(uintptr_t)tag);
+                }
+            }
+        }
     }
-    // Returns the hashed password.
-    string getPassword() const { return password; }
-    // Virtual destructor for base class.
-    virtual ~User() {}
-};
 
-// --------------------------
-// Customer Class
-// --------------------------
-// The Customer class represents a bank customer and associates them with an account.
-class Customer : public User {
-private:
-    string accountHash;
 public:
-    // Constructs a Customer with username, password, and account hash.
-    Customer(string uname, string pword, string accHash, bool isHashed = false)
-        : User(uname, pword, isHashed), accountHash(accHash) {}
-    // Returns the associated account hash.
-    string getAccountHash() const { return accountHash; }
-};
+    // saveRegistrations is passed on to every session (see CommandSession::setSaveInterval).
+    BankServer(Bank& bank, size_t saveRegistrations) : bank(bank), saveInterval(saveRegistrations) {}
 
-// --------------------------
-// Employee Class
-// --------------------------
-// The Employee class represents a bank employee with access to view all accounts.
-class Employee : public User {
-public:
-    // Constructs an Employee with username and password.
-    Employee(string uname, string pword, bool isHashed = false)
-        : User(uname, pword, isHashed) {}
-    // Allows employee to view all accounts in the bank.
-    void viewAllAccounts(class Bank& bank) const;
+    // Listens on the Unix socket at path and serves clients on `threads` threads until SIGINT or
+    // SIGTERM, then closes every session. Returns false if the socket cannot be set up.
+    bool run(const string& path, int threads) {
+        sockaddr_un addr;
+        if (!unixSocketAddress(path, addr)) {
+            return false;
+        }
+        raiseFileLimit();
+        // A socket file left by an earlier server would make bind fail
+        ::unlink(path.c_str());
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0
+            || ::listen(listenFd, SOMAXCONN) != 0) {
+            cout << "Unable to listen on " << path << ": " << strerror(errno) << '\n';
+            if (listenFd >= 0) {
+                ::close(listenFd);
+            }
+            return false;
+        }
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        serverStopFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        arm(listenFd, LISTEN_TAG, EPOLLIN, EPOLL_CTL_ADD);
+        // The stop event stays level-triggered so that every thread sees it
+        epoll_event stop;
+        stop.events = EPOLLIN;
+        stop.data.u64 = STOP_TAG;
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, serverStopFd, &stop);
+        ::signal(SIGINT, stopServer);
+        ::signal(SIGTERM, stopServer);
+
+        cout << "Serving on " << path << " with " << threads << " threads\n" << flush;
+        vector<thread> pool;
+        for (int i = 0; i < threads; i++) {
+            pool.emplace_back(&BankServer::workerLoop, this);
+        }
+        for (thread& t : pool) {
+            t.join();
+        }
+
+        for (auto& entry : connections) {
+            ::close(entry.first->fd);
+        }
+        connections.clear();
+        ::close(listenFd);
+        ::unlink(path.c_str());
+        ::close(epollFd);
+        ::close(serverStopFd);
+        ::signal(SIGINT, SIG_DFL);
+        ::signal(SIGTERM, SIG_DFL);
+        cout << "Server stopped\n";
+        return true;
+    }
 };
 
 // --------------------------
-// Bank Class
+// Load generator
 // --------------------------
-// The Bank class manages accounts, customers, and employees, and handles persistence.
-class Bank {
-private:
-    vector<Account> account;
-    int nextAccountNumber = 1000;
-    vector<Customer> customers;
-    vector<Employee> employees;
-public:
-    // Adds a customer to the bank.
-    void addCustomer(const Customer& customer) {
-        customers.push_back(customer);
-    }
-    // Adds an employee to the bank.
-    void addEmployee(const Employee& employee) {
-        employees.push_back(employee);
-    }
-    // Returns a const reference to the list of customers.
-    const vector<Customer>& getCustomers() const {
-        return customers;
-    }
-    // Returns a const reference to the list of employees.
-    const vector<Employee>& getEmployees() const {
-        return employees;
+// Registers `count` customers named prefix0, prefix1, ... with password "pw" over one text session
+// and stores their account numbers. Returns false if any registration fails.
+static bool registerLoadCustomers(const sockaddr_un& addr, const string& prefix, size_t count, vector<int>& accounts) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        cout << "Unable to connect to " << addr.sun_path << ": " << strerror(errno) << '\n';
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
     }
-    // Adds a new account with the given name and initial deposit, returns new account number.
-    int addAccount(const string& name, double initialDeposit) {
-        int newAccountNumber = nextAccountNumber++;
-        Account newAccount(name, newAccountNumber, initialDeposit);
-        account.push_back(newAccount);
-        return newAccountNumber;
+    string commands;
+    for (size_t i = 0; i < count; i++) {
+        commands += "register " + prefix + to_string(i) + " pw 1000 Load Client " + to_string(i) + "\n";
     }
-    // Finds and returns a pointer to an account by account number, or nullptr if not found.
-    Account* findAccount(int accountNum) {
-        for (int i = 0; i < account.size(); i++) {
-            if (account[i].getAccountNumber() == accountNum) {
-                return &account[i];
-            }
+    bool ok = writeFully(fd, commands.data(), commands.size());
+    string input;
+    char buffer[4096];
+    while (ok && accounts.size() < count) {
+        ssize_t got = ::read(fd, buffer, sizeof(buffer));
+        if (got <= 0) {
+            ok = false;
+            break;
         }
-        cout << "NO ACCOUNT FOUND" << endl;
-        return nullptr;
-    }
-    // Displays all accounts in the bank.
-    void showAllAccounts() const {
-        for (int i = 0; i < account.size(); i++) {
-            account[i].display();
+        input.append(buffer, got);
+        size_t start = 0;
+        size_t end;
+        // "OK registered <username> account <number>"
+        while (ok && (end = input.find('\n', start)) != string::npos) {
+            string reply = input.substr(start, end - start);
+            start = end + 1;
+            ok = reply.compare(0, 3, "OK ") == 0;
+            if (!ok) {
+                cout << "Registration failed: " << reply << '\n';
+            } else {
+                accounts.push_back(atoi(reply.c_str() + reply.rfind(' ') + 1));
+            }
         }
+        input.erase(0, start);
     }
-    // Returns a const reference to all accounts.
-    const vector<Account>& getAllAccounts() const {
-        return account;
+    ::close(fd);
+    return ok;
+}
+
+// Opens `clients` sessions to the server at path, each logged in as its own new customer. The
+// sessions then keep `depth` commands each in flight (deposits, withdrawals, transfers between
+// the new customers and balance checks) until `ops` commands have completed, speaking the text
+// commands or, with binary set, the binary protocol. Prints the throughput and latency
+// percentiles of those commands. Returns false if the run could not finish.
+bool runLoadGenerator(const string& path, size_t clients, size_t ops, size_t depth, bool binary) {
+    // One client connection and the commands it has in flight, oldest first.
+    struct Client {
+        int fd = -1;
+        string input;
+        bool loggedIn = false;
+        deque<pair<uint32_t, chrono::steady_clock::time_point>> inFlight;
+    };
+    sockaddr_un addr;
+    if (!unixSocketAddress(path, addr) || clients == 0 || depth == 0) {
+        return false;
     }
-    // Saves account data to a file in JSON format (no encryption).
-    void saveToFile(const string& filename) {
-        // Removed: no longer saving to bank.json
+    raiseFileLimit();
+    ::signal(SIGPIPE, SIG_IGN);
+    // Usernames unique to this run, so repeated runs against one server do not collide
+    string prefix = "lg" + to_string(::time(nullptr)) + "p" + to_string(::getpid()) + "c";
+    vector<int> accounts;
+    if (!registerLoadCustomers(addr, prefix, clients, accounts)) {
+        return false;
     }
-    // Loads account data from a file in JSON format (no encryption).
-    void loadFromFile(const string& filename) {
-        // Removed: no longer loading from bank.json
+
+    int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    vector<Client> pool(clients);
+    uint32_t nextId = 0;
+    // Sends one request to a client's session and notes when it went out.
+    auto sendRequest = [&](Client& client, const string& text, const ByteWriter& frame) {
+        client.inFlight.emplace_back(nextId++, chrono::steady_clock::now());
+        if (!binary) {
+            return writeFully(client.fd, text.data(), text.size());
+        }
+        return writeFully(client.fd, frame.bytes.data(), frame.bytes.size());
+    };
+    // Starts a binary request frame; the length is patched in by finishFrame.
+    auto startFrame = [&](ByteWriter& frame, WireOp op) {
+        frame.put<uint32_t>(0);
+        frame.put<uint32_t>(nextId);
+        frame.put<uint8_t>((uint8_t)op);
+    };
+    auto finishFrame = [](ByteWriter& frame) {
+        uint32_t length = (uint32_t)(frame.bytes.size() - sizeof(uint32_t));
+        memcpy(frame.bytes.data(), &length, sizeof(length));
+    };
+    for (size_t i = 0; i < clients; i++) {
+        Client& client = pool[i];
+        client.fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (client.fd < 0 || ::connect(client.fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            cout << "Unable to connect to " << path << ": " << strerror(errno) << '\n';
+            return false;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &ev);
+        ByteWriter frame;
+        if (binary) {
+            char magic = (char)BINARY_PROTOCOL_MAGIC;
+            writeFully(client.fd, &magic, 1);
+            startFrame(frame, WireOp::Auth);
+            frame.put<uint8_t>(0);
+            frame.putString(prefix + to_string(i));
+            frame.putString("pw");
+            finishFrame(frame);
+        }
+        sendRequest(client, "login " + prefix + to_string(i) + " pw\n", frame);
     }
-    // Loads customers and employees from their respective directories (no encryption).
-    void loadUsersFromFile(const string& customerFile, const string& employeeFile) {
-        // Load customers from vaults/customers/[username]/profile.json and account.json
-        customers.clear();
-        account.clear();
-        nextAccountNumber = 1000;
-        string customersDir = "vaults/customers";
-        if (fs::exists(customersDir) && fs::is_directory(customersDir)) {
-            for (const auto& entry : fs::directory_iterator(customersDir)) {
-                if (fs::is_directory(entry)) {
-                    string profilePath = entry.path().string() + "/profile.json";
-                    if (fs::exists(profilePath)) {
-                        ifstream pf(profilePath);
-                        if (pf.is_open()) {
-                            nlohmann::json cj;
-                            pf >> cj;
-                            pf.close();
-                            string username = cj.value("username", "");
-                            string password = cj.value("password", "");
-                            string accNumHash = cj.value("accountNumber", "");
-                            customers.emplace_back(username, password, accNumHash, true);
-                            // Load account.json for this customer
-                            string accountPath = entry.path().string() + "/account.json";
-                            if (fs::exists(accountPath)) {
-                                ifstream af(accountPath);
-                                if (af.is_open()) {
-                                    nlohmann::json aj;
-                                    af >> aj;
-                                    af.close();
-                                    string name = aj.value("name", "");
-                                    int number = aj.value("number", 0);
-                                    double balance = aj.value("balance", 0.0);
-                                    Account acc(name, number, balance);
-                                    account.push_back(acc);
-                                    if (number >= nextAccountNumber) {
-                                        nextAccountNumber = number + 1;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+
+    vector<double> latencies;
+    latencies.reserve(ops);
+    size_t issued = 0;
+    size_t failures = 0;
+    size_t ready = 0;
+    mt19937 rng(12345);
+    chrono::steady_clock::time_point start;
+    // Sends a client its next command, or nothing once every command has been issued.
+    auto nextCommand = [&](Client& client) {
+        if (issued == ops) {
+            return true;
+        }
+        issued++;
+        unsigned pick = rng() % 10;
+        // Transfers go to another session's customer; a lone session checks its balance instead
+        size_t self = &client - pool.data();
+        size_t other = accounts.size() > 1 ? rng() % (accounts.size() - 1) : 0;
+        if (other >= self) {
+            other++;
+        }
+        if (pick >= 7 && pick < 9 && accounts.size() == 1) {
+            pick = 9;
+        }
+        int recipient = other < accounts.size() ? accounts[other] : -1;
+        string line;
+        ByteWriter frame;
+        if (pick < 4) {
+            line = "deposit 2.50\n";
+            startFrame(frame, WireOp::Deposit);
+            frame.put<int64_t>(250);
+        } else if (pick < 7) {
+            line = "withdraw 1.25\n";
+            startFrame(frame, WireOp::Withdraw);
+            frame.put<int64_t>(125);
+        } else if (pick < 9) {
+            line = "transfer 0.75 " + to_string(recipient) + "\n";
+            startFrame(frame, WireOp::Transfer);
+            frame.put<int64_t>(75);
+            frame.put<int32_t>(recipient);
+        } else {
+            line = "show\n";
+            startFrame(frame, WireOp::Balance);
+        }
+        finishFrame(frame);
+        return sendRequest(client, line, frame);
+    };
+    // Takes the next complete reply off a client's input: its request id and whether it succeeded.
+    auto nextReply = [&](Client& client, uint32_t& id, bool& succeeded) {
+        if (!binary) {
+            size_t end = client.input.find('\n');
+            if (end == string::npos) {
+                return false;
             }
+            succeeded = client.input.compare(0, 4, "ERR ") != 0 && client.input.compare(0, 12, "Insufficient") != 0;
+            client.input.erase(0, end + 1);
+            id = client.inFlight.front().first;
+            return true;
         }
-        // Load employees from vaults/employees/[username]/profile.json and account.json (if needed)
-        employees.clear();
-        string employeesDir = "vaults/employees";
-        if (fs::exists(employeesDir) && fs::is_directory(employeesDir)) {
-            for (const auto& entry : fs::directory_iterator(employeesDir)) {
-                if (fs::is_directory(entry)) {
-                    string profilePath = entry.path().string() + "/profile.json";
-                    if (fs::exists(profilePath)) {
-                        ifstream pf(profilePath);
-                        if (pf.is_open()) {
-                            nlohmann::json ej;
-                            pf >> ej;
-                            pf.close();
-                            string username = ej.value("username", "");
-                            string password = ej.value("password", "");
-                            employees.emplace_back(username, password, true);
-                            // Optionally, load account.json for employees if you want to store their accounts too
-                            string accountPath = entry.path().string() + "/account.json";
-                            if (fs::exists(accountPath)) {
-                                ifstream af(accountPath);
-                                if (af.is_open()) {
-                                    nlohmann::json aj;
-                                    af >> aj;
-                                    af.close();
-                                    string name = aj.value("name", "");
-                                    int number = aj.value("number", 0);
-                                    double balance = aj.value("balance", 0.0);
-                                    Account acc(name, number, balance);
-                                    account.push_back(acc);
-                                    if (number >= nextAccountNumber) {
-                                        nextAccountNumber = number + 1;
-                                    }
-                                }
+        uint32_t length;
+        if (client.input.size() < sizeof(length)) {
+            return false;
+        }
+        memcpy(&length, client.input.data(), sizeof(length));
+        if (client.input.size() < sizeof(length) + length) {
+            return false;
+        }
+        ByteReader in(client.input.data() + sizeof(length), length);
+        id = in.get<uint32_t>();
+        succeeded = in.get<uint8_t>() == (uint8_t)WireStatus::Ok;
+        client.input.erase(0, sizeof(length) + length);
+        return true;
+    };
+
+    epoll_event events[64];
+    while (latencies.size() < ops) {
+        int n = ::epoll_wait(epollFd, events, 64, 10000);
+        if (n == 0) {
+            cout << "Load generator timed out waiting for the server\n";
+            return false;
+        }
+        for (int e = 0; e < n; e++) {
+            Client& client = pool[events[e].data.u64];
+            char buffer[16384];
+            ssize_t got = ::read(client.fd, buffer, sizeof(buffer));
+            if (got <= 0) {
+                cout << "Server closed the connection\n";
+                return false;
+            }
+            client.input.append(buffer, got);
+            uint32_t id;
+            bool succeeded;
+            while (nextReply(client, id, succeeded)) {
+                if (client.inFlight.empty() || id != client.inFlight.front().first) {
+                    cout << "Reply for unexpected request " << id << '\n';
+                    return false;
+                }
+                auto sent = client.inFlight.front().second;
+                client.inFlight.pop_front();
+                bool ok = true;
+                if (!client.loggedIn) {
+                    if (!succeeded) {
+                        cout << "Login failed\n";
+                        return false;
+                    }
+                    client.loggedIn = true;
+                    // Time only the steady state, from when every client is logged in
+                    if (++ready == clients) {
+                        start = chrono::steady_clock::now();
+                        for (size_t k = 0; k < depth; k++) {
+                            for (Client& c : pool) {
+                                ok = nextCommand(c) && ok;
                             }
                         }
                     }
+                } else {
+                    latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+                    failures += succeeded ? 0 : 1;
+                    ok = nextCommand(client);
                 }
-            }
-        }
-    }
-    // Saves customers and employees to their respective directories (no encryption).
-    void saveUsersToFile(const string& customerFile, const string& employeeFile) {
-        // Save customers and their account.json
-        for (const auto& c : customers) {
-            string custDir = "vaults/customers/" + c.getUsername();
-            fs::create_directories(custDir);
-            nlohmann::json cj = {
-                {"username", c.getUsername()},
-                {"password", c.getPassword()},
-                {"accountNumber", c.getAccountHash()}
-            };
-            ofstream pf(custDir + "/profile.json");
-            pf << cj.dump(4);
-            pf.close();
-            // Save account.json for this customer
-            // Find their account by matching the hash
-            for (const auto& acc : account) {
-                if (sha256(to_string(acc.getAccountNumber())) == c.getAccountHash()) {
-                    nlohmann::json aj = {
-                        {"name", acc.getOwnerName()},
-                        {"number", acc.getAccountNumber()},
-                        {"balance", acc.getBalance()}
-                    };
-                    ofstream af(custDir + "/account.json");
-                    af << aj.dump(4);
-                    af.close();
-                    break;
-                }
-            }
-        }
-        // Save employees and their account.json (if any)
-        for (const auto& e : employees) {
-            string empDir = "vaults/employees/" + e.getUsername();
-            fs::create_directories(empDir);
-            nlohmann::json ej = {
-                {"username", e.getUsername()},
-                {"password", e.getPassword()}
-            };
-            ofstream pf(empDir + "/profile.json");
-            pf << ej.dump(4);
-            pf.close();
-            // Save account.json if this employee has an account (optional)
-            // This block is only meaningful if you want to store employee-owned accounts
-            for (const auto& acc : account) {
-                if (acc.getOwnerName() == e.getUsername()) {
-                    nlohmann::json aj = {
-                        {"name", acc.getOwnerName()},
-                        {"number", acc.getAccountNumber()},
-                        {"balance", acc.getBalance()}
-                    };
-                    ofstream af(empDir + "/account.json");
-                    af << aj.dump(4);
-                    af.close();
-                    break;
+                if (!ok) {
+                    cout << "Unable to send to the server\n";
+                    return false;
                 }
             }
         }
     }
-};
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (Client& client : pool) {
+        ::close(client.fd);
+    }
+    ::close(epollFd);
 
-// Allows an employee to view all accounts in the bank.
-inline void Employee::viewAllAccounts(Bank& bank) const {
-    bank.showAllAccounts();
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    cout << ops << " " << (binary ? "binary" : "text") << " commands over " << clients << " sessions, "
+         << depth << " in flight each, in " << fixed << setprecision(3) << seconds << " s: "
+         << (long long)(seconds > 0 ? ops / seconds : 0) << " ops/s\n";
+    cout << "latency p50 " << setprecision(0) << percentile(0.50) << " us, p99 " << percentile(0.99)
+         << " us, max " << (latencies.empty() ? 0.0 : latencies.back()) << " us";
+    cout << " (" << failures << " rejected)\n";
+    return true;
 }
+#endif
 
 // ==========================================================
 //                        MAIN FUNCTION
 // ==========================================================
 // Entry point for Cherrington Bank simulation.
-int main() {
+int main(int argc, char* argv[]) {
+    // Console output is buffered and written in one go; cin stays tied to cout, so everything
+    // printed so far (including the prompt) is flushed right before each read blocks.
+    ios::sync_with_stdio(false);
+
+    // Command-line options
+    bool mmapAccounts = false;
+    int loadThreads = 0;
+    VaultFormat vaultFormat = VaultFormat::Compact;
+    bool lazyVaults = false;
+    int vaultCache = 0;
+    int vaultFanout = -1;
+    int migrateFanout = -1;
+    string batchSource;
+    int batchGroup = 1;
+    string serveSocket;
+    int serveThreads = max(1, (int)thread::hardware_concurrency());
+    string loadgenSocket;
+    int loadgenClients = 64;
+    int loadgenOps = 100000;
+    int loadgenDepth = 1;
+    bool loadgenBinary = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        // Fan-out depths are a single digit from 0 (flat) to 4
+        bool fanoutValue = i + 1 < argc && strlen(argv[i + 1]) == 1 && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '4';
+        if (arg == "--mmap-accounts") {
+            mmapAccounts = true;
+        } else if (arg == "--load-threads" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            loadThreads = atoi(argv[++i]);
+        } else if (arg == "--vault-format" && i + 1 < argc && parseVaultFormat(argv[i + 1], vaultFormat)) {
+            i++;
+        } else if (arg == "--lazy-vaults") {
+            lazyVaults = true;
+        } else if (arg == "--vault-cache" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            vaultCache = atoi(argv[++i]);
+        } else if (arg == "--vault-fanout" && fanoutValue) {
+            vaultFanout = atoi(argv[++i]);
+        } else if (arg == "--migrate-vaults" && fanoutValue) {
+            migrateFanout = atoi(argv[++i]);
+        } else if (arg == "--self-test") {
+            return runSelfTest() ? 0 : 1;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchSource = argv[++i];
+        } else if (arg == "--group" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            batchGroup = atoi(argv[++i]);
+#ifdef __linux__
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (arg == "--serve-threads" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            serveThreads = atoi(argv[++i]);
+        } else if (arg == "--loadgen" && i + 1 < argc) {
+            loadgenSocket = argv[++i];
+        } else if (arg == "--clients" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            loadgenClients = atoi(argv[++i]);
+        } else if (arg == "--ops" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            loadgenOps = atoi(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= 1024) {
+            loadgenDepth = atoi(argv[++i]);
+        } else if (arg == "--binary") {
+            loadgenBinary = true;
+#endif
+        } else {
+            cout << "Usage: " << argv[0] << " [--mmap-accounts | --lazy-vaults [--vault-cache N]]"
+                 << " [--load-threads N] [--vault-format pretty|compact|cbor|msgpack]"
+                 << " [--vault-fanout 0-4] [--batch FILE|- [--group N]]\n";
+            cout << "       " << argv[0] << " --migrate-vaults 0-4\n";
+            cout << "       " << argv[0] << " --self-test\n";
+#ifdef __linux__
+            cout << "       " << argv[0] << " [options] --serve SOCKET [--serve-threads N] [--group N]\n";
+            cout << "       " << argv[0] << " --loadgen SOCKET [--clients N] [--ops N] [--depth N] [--binary]\n";
+#endif
+            return 1;
+        }
+    }
+#ifdef __linux__
+    // The load generator is only a client; it never opens the vaults
+    if (!loadgenSocket.empty()) {
+        return runLoadGenerator(loadgenSocket, loadgenClients, loadgenOps, loadgenDepth, loadgenBinary) ? 0 : 1;
+    }
+#endif
+    // The account table holds every account, so it cannot be combined with lazy loading
+    if (mmapAccounts && lazyVaults) {
+        cout << "--mmap-accounts and --lazy-vaults cannot be used together.\n";
+        return 1;
+    }
+
     Bank account;
-    account.loadUsersFromFile("vaults/customers.json", "vaults/employees.json");
+    if (loadThreads > 0) {
+        account.setLoadThreads(loadThreads);
+    }
+    account.setVaultFormat(vaultFormat);
+    // Offline migration between customer vault layouts
+    if (migrateFanout >= 0) {
+        return account.migrateCustomerVaults(migrateFanout) ? 0 : 1;
+    }
+    if (!account.openCustomerLayout(vaultFanout)) {
+        return 1;
+    }
+    if (lazyVaults) {
+        account.enableLazyVaults(vaultCache);
+        // A lazy session neither reads nor rewrites the snapshot, so retire it before it goes stale
+        fs::remove("vaults/bank.snap");
+    }
+    // Serve accounts from the memory-mapped table if one is already built
+    bool tableOpened = mmapAccounts && account.openAccountTable();
+    // Start from the snapshot left by the last clean exit, or rebuild from the vault directories
+    if (lazyVaults || !account.loadFromFile("vaults/bank.snap")) {
+        account.loadUsersFromFile("vaults/customers.json", "vaults/employees.json");
+    }
+    if (mmapAccounts && !tableOpened) {
+        account.createAccountTable();
+    }
+    account.openTransactionLog("vaults/transactions.log");
+
+    // Scripted workloads skip the menus entirely
+    if (!batchSource.empty()) {
+        bool ran = runBatch(account, batchSource, batchGroup);
+        checkpointOnExit(account);
+        return ran ? 0 : 1;
+    }
+#ifdef __linux__
+    // Many clients at once over a Unix socket, until SIGINT or SIGTERM
+    if (!serveSocket.empty()) {
+        account.setTransactionGroupSize(batchGroup);
+        bool served = BankServer(account, batchGroup).run(serveSocket, serveThreads);
+        checkpointOnExit(account);
+        return served ? 0 : 1;
+    }
+#endif
 
     while (true) {
         // Main menu: Prompt for employee or customer or exit
         char employeeOrCustomerChoice = ' ';
-        cout << "Welcome to Cherrington Bank!" << endl;
-        cout << "Are you an employee or a customer?:" << endl;
-        cout << "(e) Employee" << endl;
-        cout << "(c) Customer" << endl;
-        cout << "(x) to exit" << endl;
+        cout << "Welcome to Cherrington Bank!\n";
+        cout << "Are you an employee or a customer?:\n";
+        cout << "(e) Employee\n";
+        cout << "(c) Customer\n";
+        cout << "(x) to exit\n";
         cout << "---> ";
         cin >> employeeOrCustomerChoice;
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << endl <<"Invalid input. Please try again." << endl;
-            cout << endl;
+            cout << "\nInvalid input. Please try again.\n";
+            cout << '\n';
             continue;
         }
 
@@ -554,43 +4397,43 @@ int main() {
         if (employeeOrCustomerChoice != 'e' && employeeOrCustomerChoice != 'E'
             && employeeOrCustomerChoice != 'c' && employeeOrCustomerChoice != 'C'
             && employeeOrCustomerChoice != 'x' && employeeOrCustomerChoice != 'X') {
-            cout << endl;
-            cout << "Invalid Choice." << endl;
-            cout << endl;
+            cout << '\n';
+            cout << "Invalid Choice.\n";
+            cout << '\n';
         }
         // Exit program
         else if (employeeOrCustomerChoice == 'x' || employeeOrCustomerChoice == 'X') {
-            cout << "Thank you for choosing Cherrington Bank!" << endl;
+            cout << "Thank you for choosing Cherrington Bank!\n";
             break;
         }
         // Customer menu branch
         else if (employeeOrCustomerChoice == 'c' || employeeOrCustomerChoice == 'C') {
             // Prompt for new or returning customer
             char newOrReturningChoice = ' ';
-            cout << endl << "Are you a returning customer or a new customer?" << endl;
-            cout << "(n) New" << endl;
-            cout << "(r) Returning" << endl;
+            cout << "\nAre you a returning customer or a new customer?\n";
+            cout << "(n) New\n";
+            cout << "(r) Returning\n";
             cout << "--->";
             cin >> newOrReturningChoice;
             if (cin.fail()) {
                 cin.clear();
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << endl;
-                cout << "Invalid input. Please try again." << endl;
-                cout << endl;
+                cout << '\n';
+                cout << "Invalid input. Please try again.\n";
+                cout << '\n';
                 continue;
             }
 
             // Handle invalid customer menu choice
             if (newOrReturningChoice != 'n' && newOrReturningChoice != 'N' &&
                 newOrReturningChoice != 'r' && newOrReturningChoice != 'R') {
-                cout << endl;
-                cout << "Invalid Choice." << endl << endl;
+                cout << '\n';
+                cout << "Invalid Choice.\n\n";
             }
             // New customer registration
             else if (newOrReturningChoice == 'n' || newOrReturningChoice == 'N') {
                 string newCustomerName = " ";
-                cout << endl << "What is your full name? : ";
+                cout << "\nWhat is your full name? : ";
                 cin.ignore();
                 getline(cin, newCustomerName);
 
@@ -599,98 +4442,96 @@ int main() {
                 cin >> newUsername;
                 cout << "Create a password: ";
                 cin >> newPassword;
+                if (!Bank::isValidUsername(newUsername)) {
+                    cout << "\nUsernames cannot contain slashes or start with a dot. Please try again.\n\n";
+                    continue;
+                }
+                if (account.hasCustomer(newUsername)) {
+                    cout << "\nThat username is already taken. Please try again.\n\n";
+                    continue;
+                }
 
-                double newCustomerDeposit = 0;
+                Money newCustomerDeposit;
                 cout << "What is your initial deposit?: ";
                 cin >> newCustomerDeposit;
-                if (cin.fail()) {
+                if (cin.fail() || newCustomerDeposit < Money()) {
                     cin.clear();
                     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << endl;
-                    cout << "Invalid input. Please try again." << endl;
-                    cout << endl;
+                    cout << '\n';
+                    cout << "Invalid input. Please try again.\n";
+                    cout << '\n';
                     continue;
                 }
 
-                cout << endl << "New customer account created successfully!" << endl << endl;
-
                 int accountNum = account.addAccount(newCustomerName, newCustomerDeposit);
+                if (accountNum < 0) {
+                    cout << "\nThe account could not be created. Please try again.\n\n";
+                    continue;
+                }
+
+                cout << "\nNew customer account created successfully!\n\n";
+
                 // Hash the account number and add the new customer
-                string accountHash = sha256(to_string(accountNum));
+                Digest accountHash = sha256_digest(to_string(accountNum));
                 Customer newCustomer(newUsername, newPassword, accountHash);
                 account.addCustomer(newCustomer);
-                // Create directory and profile.json for new customer
-                string custDir = "vaults/customers/" + newUsername;
-                fs::create_directories(custDir);
-                nlohmann::json cj = {
-                    {"username", newUsername},
-                    {"password", sha256(newPassword)},
-                    {"accountNumber", accountHash}
-                };
-                ofstream pf(custDir + "/profile.json");
-                pf << cj.dump(4);
-                pf.close();
-                cout << endl << "Account number: " << accountNum << endl;
-                cout << "Account Name: " << newCustomerName << endl;
-                cout << "Current Balance: " << newCustomerDeposit << endl << endl;
-                cout << "Retuning to main menu...." << endl << endl;
-                // Removed: account.saveToFile("vaults/bank.json");
-                account.saveUsersToFile("vaults/customers.json", "vaults/employees.json");
+                cout << "\nAccount number: " << accountNum << '\n';
+                cout << "Account Name: " << newCustomerName << '\n';
+                cout << "Current Balance: " << newCustomerDeposit << "\n\n";
+                cout << "Retuning to main menu....\n\n";
+                // Writes the new customer's profile.json and account.json
+                if (!account.saveUsersToFile("vaults/customers.json", "vaults/employees.json")) {
+                    cout << "Your account is not saved yet (" << account.lastSaveError() << "); it will be retried.\n\n";
+                }
             }
             // Returning customer login and actions
             else if (newOrReturningChoice == 'r' || newOrReturningChoice == 'R') {
                 string username, password;
-                cout << endl << "Enter username: ";
+                cout << "\nEnter username: ";
                 cin >> username;
                 cout << "Enter password: ";
                 cin >> password;
 
-                int returningAccountNumber = -1;
-                bool loginSuccess = false;
                 // Authenticate customer
-                for (const auto& cust : account.getCustomers()) {
-                    if (cust.getUsername() == username && cust.checkPassword(password)) {
-                        // Find the account number by matching the hash
-                        for (const auto& acc : account.getAllAccounts()) {
-                            if (sha256(to_string(acc.getAccountNumber())) == cust.getAccountHash()) {
-                                returningAccountNumber = acc.getAccountNumber();
-                                break;
-                            }
-                        }
-                        loginSuccess = true;
-                        break;
-                    }
-                }
-                if (!loginSuccess) {
-                    cout << endl << "INVALID LOGIN" << endl << endl;
+                const Customer* cust = account.loginCustomer(username, password);
+                if (cust == nullptr) {
+                    cout << "\nINVALID LOGIN\n\n";
                     continue;
                 }
-                cout << endl;
+                // Find the account number by its hash
+                int returningAccountNumber = -1;
+                const Account* acc = account.findAccountByHash(cust->getAccountHash());
+                if (acc != nullptr) {
+                    returningAccountNumber = acc->getAccountNumber();
+                }
+                cout << '\n';
 
                 Account* found = account.findAccount(returningAccountNumber);
 
                 if (found != nullptr) {
-                    cout << "Welcome " << found->getOwnerName() << endl;
+                    cout << "Welcome " << found->getOwnerName() << '\n';
+                    // Keep this customer loaded for the whole session
+                    account.pinCustomer(username);
                     // Customer action menu
                     while (true) {
                         char customerMenuChoice = ' ';
-                        cout << endl << "Customer Menu: " << endl;
-                        cout << "(c) Check Balance" << endl;
-                        cout << "(d) Deposit" << endl;
-                        cout << "(w) Withdrawal" << endl;
-                        cout << "(t) Tansfer" << endl;
-                        cout << "(r) Return to main menu" << endl;
+                        cout << "\nCustomer Menu: \n";
+                        cout << "(c) Check Balance\n";
+                        cout << "(d) Deposit\n";
+                        cout << "(w) Withdrawal\n";
+                        cout << "(t) Tansfer\n";
+                        cout << "(r) Return to main menu\n";
                         cout << "--->";
                         cin >> customerMenuChoice;
                         if (cin.fail()) {
                             cin.clear();
                             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                            cout << endl;
-                            cout << "Invalid input. Please try again." << endl;
-                            cout << endl;
+                            cout << '\n';
+                            cout << "Invalid input. Please try again.\n";
+                            cout << '\n';
                             continue;
                         }
-                        cout << endl;
+                        cout << '\n';
 
                         // Handle invalid customer action menu choice
                         if (customerMenuChoice != 'c' && customerMenuChoice != 'C'
@@ -698,7 +4539,7 @@ int main() {
                             && customerMenuChoice != 'w' && customerMenuChoice != 'W'
                             && customerMenuChoice != 't' && customerMenuChoice != 'T'
                             && customerMenuChoice != 'r' && customerMenuChoice != 'R') {
-                            cout << "Invalid Choice." << endl;
+                            cout << "Invalid Choice.\n";
                         }
                         // Check balance
                         else if (customerMenuChoice == 'c' || customerMenuChoice == 'C') {
@@ -707,53 +4548,61 @@ int main() {
                         }
                         // Deposit funds
                         else if (customerMenuChoice == 'd' || customerMenuChoice == 'D') {
-                            int dep = 0;
+                            Money dep;
                             cout << "How much would you like to deposit?: ";
                             cin >> dep;
                             if (cin.fail()) {
                                 cin.clear();
                                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                                cout << endl;
-                                cout << "Invalid input. Please try again." << endl;
-                                cout << endl;
+                                cout << '\n';
+                                cout << "Invalid input. Please try again.\n";
+                                cout << '\n';
                                 continue;
                             }
-                            cout << endl;
-                            found->deposit(dep);
+                            cout << '\n';
+                            AccountResult result = found->deposit(dep);
+                            reportDeposit(cout, result, dep, returningAccountNumber);
+                            if (result == AccountResult::Ok && !account.recordTransaction(*found)) {
+                                cout << NOT_DURABLE_WARNING;
+                            }
                             found->display();
                             continue;
                         }
                         // Withdraw funds
                         else if (customerMenuChoice == 'w' || customerMenuChoice == 'W') {
-                            int wd = 0;
+                            Money wd;
                             cout << "How much would you like to withdraw?: ";
                             cin >> wd;
                             if (cin.fail()) {
                                 cin.clear();
                                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                                cout << endl;
-                                cout << "Invalid input. Please try again." << endl;
-                                cout << endl;
+                                cout << '\n';
+                                cout << "Invalid input. Please try again.\n";
+                                cout << '\n';
                                 continue;
                             }
-                            cout << endl;
-                            found->withdraw(wd);
+                            cout << '\n';
+                            AccountResult result = found->withdraw(wd);
+                            reportWithdrawal(cout, result, wd, returningAccountNumber);
+                            if (result == AccountResult::Ok && !account.recordTransaction(*found)) {
+                                cout << NOT_DURABLE_WARNING;
+                            }
                             found->display();
                             continue;
                         }
                         // Transfer funds to another account
                         else if (customerMenuChoice == 't' || customerMenuChoice == 'T') {
                             int recipientNumber = 0;
-                            double transferAmount = 0;
+                            Money transferAmount;
 
                             cout << "How much would you like to transfer? :$";
                             cin >> transferAmount;
                             if (cin.fail()) {
                                 cin.clear();
                                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                                cout << endl;
-                                cout << "Invalid input. Please try again." << endl;
-                                cout << endl;
+                                cout << '\n';
+                                cout << "Invalid input. Please try again.\n";
+                                cout << '\n';
                                 continue;
                             }
 
@@ -762,45 +4611,56 @@ int main() {
                             if (cin.fail()) {
                                 cin.clear();
                                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                                cout << "Invalid input. Please try again." << endl;
+                                cout << "Invalid input. Please try again.\n";
                                 continue;
                             }
 
                             Account* recipientAccount = account.findAccount(recipientNumber);
+                            // Loading the recipient may have moved this customer's account
+                            found = account.findAccount(returningAccountNumber);
 
                             if (recipientAccount != nullptr) {
-                                cout << endl;
-                                found->transferTo(*recipientAccount, transferAmount);
+                                cout << '\n';
+                                AccountResult result = found->transferTo(*recipientAccount, transferAmount);
+                                reportTransfer(cout, result, transferAmount, returningAccountNumber, recipientNumber);
+                                if (result == AccountResult::Ok && !account.recordTransaction(*found, recipientAccount)) {
+                                    cout << NOT_DURABLE_WARNING;
+                                }
                                 found->display();
                             }
                             else {
-                                cout << "Transfer failed: recipient account not found." << endl;
+                                cout << "NO ACCOUNT FOUND\n";
+                                cout << "Transfer failed: recipient account not found.\n";
                             }
                         }
                         // Return to main menu
                         else if (customerMenuChoice == 'r' || customerMenuChoice == 'R') {
-                            cout << "Returning to main menu...." << endl << endl;
+                            cout << "Returning to main menu....\n\n";
+                            account.unpinCustomer(username);
                             break;
                         }
                     }
                 }
+                else {
+                    cout << "NO ACCOUNT FOUND\n";
+                }
             }
         }
         // Employee menu branch
         else if (employeeOrCustomerChoice == 'e' || employeeOrCustomerChoice == 'E') {
             // Prompt for new or returning employee
             char newOrExisting = ' ';
-            cout << endl << "Are you a new or existing employee?" << endl;
-            cout << "(n) New" << endl;
-            cout << "(r) Returning" << endl;
+            cout << "\nAre you a new or existing employee?\n";
+            cout << "(n) New\n";
+            cout << "(r) Returning\n";
             cout << "---> ";
             cin >> newOrExisting;
             if (cin.fail()) {
                 cin.clear();
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << endl;
-                cout << "Invalid input. Please try again." << endl;
-                cout << endl;
+                cout << '\n';
+                cout << "Invalid input. Please try again.\n";
+                cout << '\n';
                 continue;
             }
 
@@ -811,89 +4671,81 @@ int main() {
                 cin >> newUsername;
                 cout << "Create a password: ";
                 cin >> newPassword;
+                if (!Bank::isValidUsername(newUsername)) {
+                    cout << "\nUsernames cannot contain slashes or start with a dot. Please try again.\n\n";
+                    continue;
+                }
+                if (account.hasEmployee(newUsername)) {
+                    cout << "\nThat username is already taken. Please try again.\n\n";
+                    continue;
+                }
 
                 Employee newEmployee(newUsername, newPassword);
                 account.addEmployee(newEmployee);
-                // Create directory and profile.json for new employee
-                string empDir = "vaults/employees/" + newUsername;
-                fs::create_directories(empDir);
-                nlohmann::json ej = {
-                    {"username", newUsername},
-                    {"password", sha256(newPassword)}
-                };
-                ofstream pf(empDir + "/profile.json");
-                pf << ej.dump(4);
-                pf.close();
-                account.saveUsersToFile("vaults/customers.json", "vaults/employees.json");
-
-                cout << endl << "New employee account created successfully!" << endl << endl;
+                // Writes the new employee's profile.json
+                if (!account.saveUsersToFile("vaults/customers.json", "vaults/employees.json")) {
+                    cout << "\nYour account is not saved yet (" << account.lastSaveError() << "); it will be retried.\n";
+                }
+
+                cout << "\nNew employee account created successfully!\n\n";
                 continue;
             }
 
             // Returning employee login and actions
             string username, password;
-            cout << endl << "Enter username: ";
+            cout << "\nEnter username: ";
             cin >> username;
             cout << "Enter password: ";
             cin >> password;
-            cout << endl;
+            cout << '\n';
 
-            bool loginSuccess = false;
             // Authenticate employee
-            for (const auto& emp : account.getEmployees()) {
-                if (emp.getUsername() == username && emp.checkPassword(password)) {
-                    loginSuccess = true;
-                    break;
-                }
-            }
-
-            if (!loginSuccess) {
-                cout << endl;
-                cout << "INVALID LOGIN" << endl;
-                cout << endl;
+            if (account.loginEmployee(username, password) == nullptr) {
+                cout << '\n';
+                cout << "INVALID LOGIN\n";
+                cout << '\n';
                 continue;
             }
 
             // Employee action menu
             while (true) {
                 char employeeChoice = ' ';
-                cout << "Employee Menu: " << endl;
-                cout << "(s) Show all accounts" << endl;
-                cout << "(r) Return to main menu" << endl;
+                cout << "Employee Menu: \n";
+                cout << "(s) Show all accounts\n";
+                cout << "(r) Return to main menu\n";
                 cout << "--->";
                 cin >> employeeChoice;
                 if (cin.fail()) {
                     cin.clear();
                     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Invalid input. Please try again." << endl;
+                    cout << "Invalid input. Please try again.\n";
                     continue;
                 }
-                cout << endl;
+                cout << '\n';
 
                 // Handle invalid employee action menu choice
                 if (employeeChoice != 's' && employeeChoice != 'S' &&
                     employeeChoice != 'r' && employeeChoice != 'R') {
-                    cout << endl;
-                    cout << "INVALID CHOICE" << endl;
-                    cout << endl;
+                    cout << '\n';
+                    cout << "INVALID CHOICE\n";
+                    cout << '\n';
                     continue;
                 }
                 // Show all accounts
                 if (employeeChoice == 's' || employeeChoice == 'S') {
                     account.showAllAccounts();
-                    cout << endl;
+                    cout << '\n';
                     continue;
                 }
                 // Return to main menu
                 if (employeeChoice == 'r' || employeeChoice == 'R') {
-                    cout << "Returning to main menu...." << endl << endl;
+                    cout << "Returning to main menu....\n\n";
                     break;
                 }
             }
         }
     }
     // Save all data before exiting
-    // Removed: account.saveToFile("vaults/bank.json");
-    account.saveUsersToFile("vaults/customers.json", "vaults/employees.json");
+    checkpointOnExit(account);
     return 0;
 }
\ No newline at end of file